@@ -26,6 +26,27 @@ func run_config() -> void:
 		print("Result: ", i)
 
 
+# Build with GDEXPR_COMPILER_TIMING_DEBUG defined to time native_literals against Expression on a large config.
+func run_large_config() -> void:
+	var expression_inputs: Array = Array()
+
+	var script_results: Array = GDExpr.execute_file(
+		expression_inputs, self, "res://demo/test_large_config.gdexpr"
+	)
+	print("Large config results: ", script_results.size())
+
+
+# Build with GDEXPR_COMPILER_DEBUG defined to check the lexer's SIMD skipping against the scalar loop.
+func run_lexer_test() -> void:
+	var expression_inputs: Array = Array()
+
+	var script_results: Array = GDExpr.execute_file(
+		expression_inputs, self, "res://demo/test_lexer_blocks.gdexpr"
+	)
+	for i in script_results:
+		print("Result: ", i)
+
+
 # NOTE: Functions run in GDExpr cannot return void, they must return a Variant value of some kind.
 # If they return void when evaluated as an expression
 # they will return Variant::NIL, which will cause the expression to fail.
@@ -6,3 +6,5 @@ func _ready() -> void:
 	var example_script_context = preload("res://demo/example_gdexpr_script.gd").new()
 	example_script_context.run_config()
 	example_script_context.run()
+	example_script_context.run_lexer_test()
+	example_script_context.run_large_config()
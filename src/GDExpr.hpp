@@ -71,10 +71,33 @@ GDExpr syntax allows. So the compiler has to also do a lot of really weird stuff
 #include "godot_cpp/classes/dir_access.hpp"
 #include "godot_cpp/classes/expression.hpp"
 #include "godot_cpp/classes/file_access.hpp"
+#include "godot_cpp/classes/mutex.hpp"
+#include "godot_cpp/classes/os.hpp"
+#include "godot_cpp/classes/resource.hpp"
 #include "godot_cpp/classes/time.hpp"
+#include "godot_cpp/classes/worker_thread_pool.hpp"
+#include "godot_cpp/core/mutex_lock.hpp"
+#include "godot_cpp/templates/hash_map.hpp"
 #include "godot_cpp/templates/hash_set.hpp"
+#include "godot_cpp/templates/list.hpp"
+#include "godot_cpp/variant/callable_method_pointer.hpp"
+#include "godot_cpp/variant/typed_array.hpp"
 #include "godot_cpp/variant/utility_functions.hpp"
 
+#include "GDExprFormat.hpp"
+#include "GDExprOptimizer.hpp"
+
+// The lexer skips over the ordinary bytes of UTF-8 source with SSE2 when the target has it, otherwise it uses the scalar loop.
+// SSE2 is part of every x86_64 target, so it doesn't need a build option or a runtime check.
+#if defined(__SSE2__) or defined(_M_X64) or (defined(_M_IX86_FP) and _M_IX86_FP >= 2)
+#define GDEXPR_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 using namespace godot;
 
 namespace gdexpr {
@@ -86,6 +109,10 @@ namespace gdexpr {
 // NOTE: Uncomment this to enable logging when debugging the comptime parts of the compiler.
 //#define GDEXPR_COMPTIME_DEBUG
 
+// Version of the compiled output. Bump this whenever the compiler changes what it compiles a script to, anything compiled by another version is thrown away by the
+// compile cache.
+#define GDEXPR_COMPILER_VERSION 2
+
 // Measure execution time of m_code with a label m_thing_to_time in microseconds and print the result.
 #define TIME_MICRO(m_thing_to_time, m_code)                                                                                                                                   \
 	uint64_t X_##m_thing_to_time##_start = Time::get_singleton()->get_ticks_usec();                                                                                           \
@@ -118,274 +145,2274 @@ class GDExprScript : public RefCounted {
 	GDCLASS(GDExprScript, RefCounted)
 
 private:
+	// Variables declared with "var" are compiled to an index into slots so reading and writing them at runtime is just an array access.
+	// The names of the slots are only needed for the name based get_var and set_var, variables that aren't part of the current slot layout live in runtime_variables.
+	Vector<Variant> slots;
+	PackedStringArray slot_names;
+	HashMap<String, int> slot_indices;
 	Dictionary runtime_variables;
 
+	// When variables are compiled to expression inputs the slots are mirrored into the inputs array of the running program so the expressions see every write.
+	Array slot_inputs;
+	int slot_inputs_offset = -1;
+
+	_FORCE_INLINE_ void write_slot(int p_slot, const Variant &p_value) {
+		slots.write[p_slot] = p_value;
+		if (slot_inputs_offset >= 0)
+			slot_inputs[slot_inputs_offset + p_slot] = p_value;
+	}
+
 protected:
 	static void _bind_methods() {
 		ClassDB::bind_method(D_METHOD("get_var"), &GDExprScript::get_var);
 		ClassDB::bind_method(D_METHOD("set_var", "var_name", "var_value"), &GDExprScript::set_var);
+		ClassDB::bind_method(D_METHOD("get_slot", "slot"), &GDExprScript::get_slot);
+		ClassDB::bind_method(D_METHOD("set_slot", "slot", "var_value"), &GDExprScript::set_slot);
 	}
 
 public:
 	GDExprScript() {}
 
-	// IMPORTANT NOTE: If the base_instance passed into a GDExpr expression does not have get_var, set_var and a Dictionary class variables in GDExpr will not work and will
+	// IMPORTANT NOTE: If the base_instance passed into a GDExpr expression does not have get_slot and set_slot, variables in GDExpr will not work and will
 	// cause the expression to fail! So be sure to inherit from GDExprScript.
-	Variant get_var(String var_name) { return runtime_variables[var_name]; }
+	Variant get_slot(int slot) const {
+		if (slot < 0 or slot >= slots.size())
+			return Variant();
+
+		return slots[slot];
+	}
+
+	int set_slot(int slot, Variant var_value) {
+		ERR_FAIL_COND_V(slot < 0, 0);
+
+		// Slots past the bound layout are grown as they are used, so a slot number is never out of range.
+		if (slot >= slots.size())
+			slots.resize(slot + 1);
+
+		write_slot(slot, var_value);
+		return 0;
+	}
+
+	// Name based access to variables, kept so code outside of gdexpr can still read and write variables by name.
+	Variant get_var(String var_name) {
+		const int *slot = slot_indices.getptr(var_name);
+		if (slot)
+			return slots[*slot];
+
+		return runtime_variables[var_name];
+	}
+
 	int set_var(String var_name, Variant var_value) {
+		const int *slot = slot_indices.getptr(var_name);
+		if (slot) {
+			write_slot(*slot, var_value);
+			return 0;
+		}
+
 		runtime_variables[var_name] = var_value;
 		return 0;
 	}
+
+	// Switch to the slot layout of a program before executing it. Values are carried over by name so variables keep their values between programs and executions.
+	void bind_slots(const PackedStringArray &p_slot_names) {
+		if (p_slot_names.ptr() == slot_names.ptr() or p_slot_names == slot_names)
+			return;
+
+		for (const KeyValue<String, int> &E : slot_indices) {
+			runtime_variables[E.key] = slots[E.value];
+		}
+
+		slot_names = p_slot_names;
+		slot_indices.clear();
+		slots.resize(slot_names.size());
+		for (int i = 0; i < slot_names.size(); ++i) {
+			const String &name = slot_names[i];
+			slot_indices.insert(name, i);
+			slots.write[i] = runtime_variables.get(name, Variant());
+			runtime_variables.erase(name);
+		}
+	}
+
+	// Copy the bound slots into p_inputs starting at p_offset and keep writing every slot change into it until unbind_slot_inputs is called.
+	void bind_slot_inputs(const Array &p_inputs, int p_offset) {
+		ERR_FAIL_COND(p_offset < 0 or p_offset + slots.size() > p_inputs.size());
+		slot_inputs = p_inputs;
+		slot_inputs_offset = p_offset;
+		for (int i = 0; i < slots.size(); ++i) {
+			slot_inputs[p_offset + i] = slots[i];
+		}
+	}
+
+	void unbind_slot_inputs() {
+		slot_inputs = Array();
+		slot_inputs_offset = -1;
+	}
 };
 
-struct SortByLongest {
-	bool operator()(const String &a, const String &b) const { return a.length() > b.length(); }
+// Parsed expressions are keyed by their text and the input names they were parsed with, since the same text parses differently depending on its inputs.
+struct ExpressionCacheKey {
+	String text;
+	String input_signature;
+
+	bool operator==(const ExpressionCacheKey &p_other) const { return text == p_other.text and input_signature == p_other.input_signature; }
 };
 
-_ALWAYS_INLINE_ PackedStringArray whitespace_split(const String &p_string, const char *p_splitter) {
-	PackedStringArray ret;
-	bool inside_quote = false;
-	bool quote_type = false; // false for single quote, true for double quote
-	String current_word;
-	bool comment_started = false;
-
-	for (int i = 0; i < p_string.length(); i++) {
-		if (p_string[i] == '#' && !inside_quote && !comment_started) {
-			comment_started = true;
-		} else if (p_string[i] == '\n' && comment_started) {
-			comment_started = false;
-		} else if (!comment_started) {
-			if (p_string[i] == '"' && !inside_quote) {
-				inside_quote = true;
-				quote_type = true;
-				current_word += p_string[i];
-			} else if (p_string[i] == '"' && inside_quote && quote_type) {
-				inside_quote = false;
-				current_word += p_string[i];
-			} else if (p_string[i] == '\'' && !inside_quote) {
-				inside_quote = true;
-				quote_type = false;
-				current_word += p_string[i];
-			} else if (p_string[i] == '\'' && inside_quote && !quote_type) {
-				inside_quote = false;
-				current_word += p_string[i];
-			} else if (p_string[i] == *p_splitter && !inside_quote) {
-				if (!current_word.is_empty()) {
-					ret.push_back(current_word);
-					current_word = "";
-				}
-			} else {
-				current_word += p_string[i];
+struct ExpressionCacheKeyHasher {
+	static _FORCE_INLINE_ uint32_t hash(const ExpressionCacheKey &p_key) { return hash_murmur3_one_32(uint32_t(p_key.text.hash()), uint32_t(p_key.input_signature.hash())); }
+};
+
+// Pool of parsed godot expressions with least recently used eviction.
+// Parsing is most of the cost of running an expression, so when the same expression is executed again a cache hit goes straight to Expression::execute.
+// An Expression keeps the error state of its last execute, so a cached expression is only handed out while nothing but the cache holds it. Two programs
+// alive at the same time never share an Expression, the second one parses its own.
+class ExpressionCache {
+	struct Entry {
+		Ref<Expression> expression;
+		List<ExpressionCacheKey>::Element *lru_element = nullptr;
+	};
+
+	HashMap<ExpressionCacheKey, Entry, ExpressionCacheKeyHasher> entries;
+	List<ExpressionCacheKey> lru; // Most recently used keys are at the front, the back is evicted first.
+	int max_size = 1024;
+	Ref<Mutex> mutex; // Programs can be compiled on several threads at once so every access to the cache is locked.
+
+	void evict_to(int p_size) {
+		while (entries.size() > uint32_t(MAX(p_size, 0))) {
+			List<ExpressionCacheKey>::Element *oldest = lru.back();
+			entries.erase(oldest->get());
+			lru.erase(oldest);
+		}
+	}
+
+public:
+	ExpressionCache() { mutex.instantiate(); }
+
+	// Returns a parsed expression for p_text, only parsing it if it isn't already cached.
+	// Expressions that fail to parse are cached too, executing them will report the parse error the same way a fresh parse would.
+	Ref<Expression> get_expression(const String &p_text, const PackedStringArray &p_input_names = PackedStringArray()) {
+		ExpressionCacheKey key;
+		key.text = p_text;
+		key.input_signature = String(",").join(p_input_names);
+
+		MutexLock lock(*mutex.ptr());
+		Entry *entry = entries.getptr(key);
+		if (entry and entry->expression->get_reference_count() == 1) {
+			lru.move_to_front(entry->lru_element);
+			return entry->expression;
+		}
+
+		if (entry) {
+			// Still used by another program.
+			Ref<Expression> expression;
+			expression.instantiate();
+			expression->parse(p_text, p_input_names);
+			return expression;
+		}
+
+		Ref<Expression> expression;
+		expression.instantiate();
+		expression->parse(p_text, p_input_names);
+
+		if (max_size <= 0)
+			return expression;
+
+		evict_to(max_size - 1);
+
+		Entry new_entry;
+		new_entry.expression = expression;
+		new_entry.lru_element = lru.push_front(key);
+		entries.insert(key, new_entry);
+		return expression;
+	}
+
+	void set_max_size(int p_max_size) {
+		MutexLock lock(*mutex.ptr());
+		max_size = p_max_size;
+		evict_to(max_size);
+	}
+
+	int get_max_size() const { return max_size; }
+
+	void clear() {
+		MutexLock lock(*mutex.ptr());
+		entries.clear();
+		lru.clear();
+	}
+};
+
+// A token of gdexpr source code. Tokens are spans into the source, the text of a token is only copied out of the source once the compiler actually needs it.
+struct SourceToken {
+	int offset = 0;
+	int length = 0;
+	int line = 0;
+};
+
+// Bytes the lexer has to stop at: whitespace and other control characters, comments and quotes. Everything else is part of the current token.
+_ALWAYS_INLINE_ bool is_source_special_char(char p_char) {
+	return uint8_t(p_char) <= ' ' or p_char == '#' or p_char == '"' or p_char == '\'';
+}
+
+_ALWAYS_INLINE_ int count_trailing_zeros(uint32_t p_mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, p_mask);
+	return int(index);
+#else
+	return __builtin_ctz(p_mask);
+#endif
+}
+
+// Returns the index of the first special byte (see is_source_special_char) at or after p_from, or p_length if there is none.
+_ALWAYS_INLINE_ int find_source_special_char_scalar(const char *p_chars, int p_from, int p_length) {
+	for (int i = p_from; i < p_length; ++i) {
+		if (is_source_special_char(p_chars[i]))
+			return i;
+	}
+
+	return p_length;
+}
+
+// Same as find_source_special_char_scalar, but tokens in large @config files are long runs of ordinary bytes so they are skipped 16 bytes at a time with SSE2.
+_ALWAYS_INLINE_ int find_source_special_char_simd(const char *p_chars, int p_from, int p_length) {
+	int i = p_from;
+
+#ifdef GDEXPR_SSE2
+	const __m128i control_max = _mm_set1_epi8(' ');
+	const __m128i hash = _mm_set1_epi8('#');
+	const __m128i double_quote = _mm_set1_epi8('"');
+	const __m128i single_quote = _mm_set1_epi8('\'');
+	for (; i + 16 <= p_length; i += 16) {
+		const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p_chars + i));
+		const __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(block, control_max), block);
+		const __m128i is_quote = _mm_or_si128(_mm_cmpeq_epi8(block, double_quote), _mm_cmpeq_epi8(block, single_quote));
+		const __m128i is_special = _mm_or_si128(_mm_or_si128(is_control, is_quote), _mm_cmpeq_epi8(block, hash));
+		const uint32_t mask = uint32_t(_mm_movemask_epi8(is_special));
+		if (mask)
+			return i + count_trailing_zeros(mask);
+	}
+#endif
+
+	return find_source_special_char_scalar(p_chars, i, p_length);
+}
+
+_ALWAYS_INLINE_ int find_source_special_char(const char *p_chars, int p_from, int p_length) {
+#ifdef GDEXPR_COMPILER_DEBUG
+	// Every skip is checked against the scalar loop when debugging the compiler, lexing project/demo/test_lexer_blocks.gdexpr covers the block edges.
+	const int special_char = find_source_special_char_simd(p_chars, p_from, p_length);
+	const int expected_special_char = find_source_special_char_scalar(p_chars, p_from, p_length);
+	ERR_FAIL_COND_V_MSG(special_char != expected_special_char, expected_special_char,
+			vformat("GDExpr lexer SIMD skip stopped at byte %d instead of %d.", special_char, expected_special_char));
+	return special_char;
+#else
+	return find_source_special_char_simd(p_chars, p_from, p_length);
+#endif
+}
+
+// Strings are lexed a character at a time, only UTF-8 source is large enough for skipping ahead to matter.
+_ALWAYS_INLINE_ int find_source_special_char(const char32_t *, int p_from, int) { return p_from; }
+
+// Returns the index of the first newline at or after p_from, or p_length if there is none.
+_ALWAYS_INLINE_ int find_line_end(const char *p_chars, int p_from, int p_length) {
+	if (p_from >= p_length)
+		return p_length;
+
+	const char *line_end = static_cast<const char *>(memchr(p_chars + p_from, '\n', p_length - p_from));
+	return line_end ? int(line_end - p_chars) : p_length;
+}
+
+_ALWAYS_INLINE_ int find_line_end(const char32_t *p_chars, int p_from, int p_length) {
+	int i = p_from;
+	while (i < p_length and p_chars[i] != '\n') {
+		i++;
+	}
+
+	return i;
+}
+
+// Split gdexpr source code into tokens in a single pass over the source. Tokens are separated by spaces, tabs and carriage returns, the text between quotes is
+// always part of a token and comments run from a '#' outside of quotes to the end of the line. Quotes never continue on the next line.
+// T is either char32_t for a String or char for UTF-8 bytes, every character the lexer looks for is ASCII and the bytes of a multi-byte UTF-8 character never are.
+// r_tokens is cleared first so the same vector can be reused without allocating again.
+template <typename T>
+_ALWAYS_INLINE_ void tokenize_source(const T *p_chars, int p_length, LocalVector<SourceToken> &r_tokens) {
+	r_tokens.clear();
+	const T *chars = p_chars;
+	const int length = p_length;
+
+	int line = 0;
+	int token_start = -1;
+	T quote = 0;
+
+	for (int i = 0; i < length; ++i) {
+		const T c = chars[i];
+
+		if (quote) {
+			if (c == quote) {
+				quote = 0;
+				continue;
+			} else if (c != '\n') {
+				i = find_source_special_char(chars, i + 1, length) - 1;
+				continue;
+			}
+		}
+
+		if (c == '"' or c == '\'') {
+			quote = c;
+			if (token_start < 0)
+				token_start = i;
+			continue;
+		}
+
+		if (c == ' ' or c == '\t' or c == '\r' or c == '\n' or c == '#') {
+			if (token_start >= 0) {
+				SourceToken token;
+				token.offset = token_start;
+				token.length = i - token_start;
+				token.line = line;
+				r_tokens.push_back(token);
+				token_start = -1;
+			}
+
+			quote = 0;
+			if (c == '#') {
+				i = find_line_end(chars, i + 1, length) - 1;
+			} else if (c == '\n') {
+				line++;
+			}
+
+			continue;
+		}
+
+		if (token_start < 0)
+			token_start = i;
+
+		i = find_source_special_char(chars, i + 1, length) - 1;
+	}
+
+	if (token_start >= 0) {
+		SourceToken token;
+		token.offset = token_start;
+		token.length = length - token_start;
+		token.line = line;
+		r_tokens.push_back(token);
+	}
+}
+
+// Source code for the compiler. Files are kept as their raw UTF-8 bytes and lexed without ever decoding the whole file, only the text of the tokens the compiler
+// actually looks at is decoded into Strings. Source passed in as a String (GDExpr.execute) is lexed as it is.
+class SourceBuffer {
+	String text;
+	PackedByteArray bytes;
+	String path; // Empty if the source isn't a file.
+	int utf8_start = 0; // Skips the byte order mark.
+	bool is_utf8 = false;
+
+public:
+	SourceBuffer() {}
+	SourceBuffer(const String &p_text) :
+			text(p_text) {}
+	SourceBuffer(const PackedByteArray &p_bytes, const String &p_path = String()) :
+			bytes(p_bytes),
+			path(p_path),
+			is_utf8(true) {
+		if (bytes.size() >= 3 and bytes[0] == 0xEF and bytes[1] == 0xBB and bytes[2] == 0xBF)
+			utf8_start = 3;
+	}
+
+	const String &get_path() const { return path; }
+	uint32_t get_content_hash() const { return is_utf8 ? hash_murmur3_buffer(get_utf8(), get_utf8_length()) : text.hash(); }
+
+	bool has_utf8() const { return is_utf8; }
+	const char *get_utf8() const { return reinterpret_cast<const char *>(bytes.ptr()) + utf8_start; }
+	int get_utf8_length() const { return is_utf8 ? int(bytes.size()) - utf8_start : 0; }
+	const String &get_text() const { return text; }
+	bool is_empty() const { return is_utf8 ? get_utf8_length() <= 0 : text.is_empty(); }
+
+	void tokenize(LocalVector<SourceToken> &r_tokens) const {
+		if (is_utf8) {
+			tokenize_source(get_utf8(), get_utf8_length(), r_tokens);
+		} else {
+			tokenize_source(text.ptr(), text.length(), r_tokens);
+		}
+	}
+
+	String get_token_text(const SourceToken &p_token) const {
+		return is_utf8 ? String::utf8(get_utf8() + p_token.offset, p_token.length) : text.substr(p_token.offset, p_token.length);
+	}
+
+	// Copy the text of the tokens [p_start, p_end) out of the source.
+	PackedStringArray get_token_strings(const LocalVector<SourceToken> &p_tokens, int p_start, int p_end) const {
+		PackedStringArray token_strings;
+		token_strings.resize(p_end - p_start);
+		for (int i = p_start; i < p_end; ++i) {
+			token_strings.set(i - p_start, get_token_text(p_tokens[i]));
+		}
+
+		return token_strings;
+	}
+};
+
+// Returns the end of the line the token at p_start is on, as the index of the first token on a later line.
+_ALWAYS_INLINE_ int get_line_end(const LocalVector<SourceToken> &p_tokens, int p_start) {
+	int end = p_start;
+	while (end < int(p_tokens.size()) and p_tokens[end].line == p_tokens[p_start].line) {
+		end++;
+	}
+
+	return end;
+}
+
+// Find the next identifier in p_chars starting at r_position and move r_position past it. Returns the start of the identifier, or -1 if there are no more.
+// Identifiers inside strings, names after a '.' and the letters of numbers like 1e5 are skipped.
+_ALWAYS_INLINE_ int find_next_identifier(const char32_t *p_chars, int p_length, int &r_position) {
+	int i = r_position;
+	while (i < p_length) {
+		const char32_t c = p_chars[i];
+		if (c == '"' or c == '\'') {
+			i++;
+			while (i < p_length and p_chars[i] != c) {
+				i += p_chars[i] == '\\' ? 2 : 1;
+			}
+			i++;
+			continue;
+		}
+
+		if (c >= '0' and c <= '9') {
+			while (i < p_length and (is_identifier_char(p_chars[i]) or p_chars[i] == '.')) {
+				i++;
 			}
+			continue;
+		}
+
+		if (!is_identifier_start(c)) {
+			i++;
+			continue;
 		}
+
+		const int identifier_start = i;
+		while (i < p_length and is_identifier_char(p_chars[i])) {
+			i++;
+		}
+
+		if (identifier_start > 0 and p_chars[identifier_start - 1] == '.')
+			continue;
+
+		r_position = i;
+		return identifier_start;
 	}
 
-	if (!current_word.is_empty()) {
-		ret.push_back(current_word);
+	r_position = MIN(i, p_length);
+	return -1;
+}
+
+// Replace every identifier in p_text that is a key of p_replacements, or of p_fallback_replacements if it isn't, with its value in a single scan.
+// Only whole identifiers are replaced, see find_next_identifier.
+_ALWAYS_INLINE_ String substitute_identifiers(
+		const String &p_text, const HashMap<String, String> &p_replacements, const HashMap<String, String> *p_fallback_replacements = nullptr) {
+	if (p_replacements.is_empty() and (p_fallback_replacements == nullptr or p_fallback_replacements->is_empty()))
+		return p_text;
+
+	const char32_t *chars = p_text.ptr();
+	const int length = p_text.length();
+	String result;
+	int copied_to = 0;
+
+	int position = 0;
+	int identifier_start = find_next_identifier(chars, length, position);
+	for (; identifier_start >= 0; identifier_start = find_next_identifier(chars, length, position)) {
+		const String identifier = p_text.substr(identifier_start, position - identifier_start);
+		const String *replacement = p_replacements.getptr(identifier);
+		if (replacement == nullptr and p_fallback_replacements != nullptr)
+			replacement = p_fallback_replacements->getptr(identifier);
+
+		if (replacement == nullptr)
+			continue;
+
+		result += p_text.substr(copied_to, identifier_start - copied_to) + *replacement;
+		copied_to = position;
 	}
 
-	return ret;
+	if (copied_to == 0)
+		return p_text;
+
+	return result + p_text.substr(copied_to);
 }
 
-// Same as the above function but returns a String. Used in the config script compiler because it is considerably faster than joining PackedStringArrays
-// TODO - merge these 2 functions using a template...they do the same thing.
-_ALWAYS_INLINE_ String whitespace_split_string(const String &p_string, const char *p_splitter) {
+// Move every get_slot(N) and set_slot(N, ...) call in a compiled expression to slot p_slot_map[N]. Used to link files that were compiled on their own into one program.
+_ALWAYS_INLINE_ String remap_slots(const String &p_expression, const LocalVector<int> &p_slot_map) {
+	LocalVector<ExpressionToken> tokens;
+	tokenize_expression(p_expression, tokens);
+
 	String result;
-	bool inside_quote = false;
-	bool quote_type = false; // false for single quote, true for double quote
-	String current_word;
-	bool comment_started = false;
-
-	for (int i = 0; i < p_string.length(); i++) {
-		if (p_string[i] == '#' && !inside_quote && !comment_started) {
-			comment_started = true;
-		} else if (p_string[i] == '\n' && comment_started) {
-			comment_started = false;
-		} else if (!comment_started) {
-			if (p_string[i] == '"' && !inside_quote) {
-				inside_quote = true;
-				quote_type = true;
-				current_word += p_string[i];
-			} else if (p_string[i] == '"' && inside_quote && quote_type) {
-				inside_quote = false;
-				current_word += p_string[i];
-			} else if (p_string[i] == '\'' && !inside_quote) {
-				inside_quote = true;
-				quote_type = false;
-				current_word += p_string[i];
-			} else if (p_string[i] == '\'' && inside_quote && !quote_type) {
-				inside_quote = false;
-				current_word += p_string[i];
-			} else if (p_string[i] == *p_splitter && !inside_quote) {
-				if (!current_word.is_empty()) {
-					result += current_word + " ";
-					current_word = "";
+	int copied_to = 0;
+	for (uint32_t i = 0; i + 2 < tokens.size(); ++i) {
+		if (tokens[i].type != ExpressionToken::IDENTIFIER or tokens[i + 2].type != ExpressionToken::NUMBER)
+			continue;
+
+		const String name = p_expression.substr(tokens[i].start, tokens[i].length);
+		if ((name != "get_slot" and name != "set_slot") or p_expression.substr(tokens[i + 1].start, tokens[i + 1].length) != "(")
+			continue;
+
+		const ExpressionToken &slot_token = tokens[i + 2];
+		const int slot = p_expression.substr(slot_token.start, slot_token.length).to_int();
+		if (slot < 0 or slot >= int(p_slot_map.size()) or p_slot_map[slot] == slot)
+			continue;
+
+		result += p_expression.substr(copied_to, slot_token.start - copied_to) + itos(p_slot_map[slot]);
+		copied_to = slot_token.end();
+	}
+
+	if (copied_to == 0)
+		return p_expression;
+
+	return result + p_expression.substr(copied_to);
+}
+
+_ALWAYS_INLINE_ String expression_buffer_to_string(LocalVector<char> &p_buffer) { return String::utf8(p_buffer.ptr(), p_buffer.size()); }
+
+_ALWAYS_INLINE_ String expression_buffer_to_string(LocalVector<char32_t> &p_buffer) {
+	p_buffer.push_back(0);
+	return String(p_buffer.ptr());
+}
+
+_ALWAYS_INLINE_ bool token_begins_with(const SourceToken &p_token, const char *p_chars, const char *p_prefix, int p_prefix_length) {
+	return p_token.length >= p_prefix_length and memcmp(p_chars + p_token.offset, p_prefix, p_prefix_length) == 0;
+}
+
+_ALWAYS_INLINE_ bool token_begins_with(const SourceToken &p_token, const char32_t *p_chars, const char *p_prefix, int p_prefix_length) {
+	if (p_token.length < p_prefix_length)
+		return false;
+
+	for (int i = 0; i < p_prefix_length; ++i) {
+		if (p_chars[p_token.offset + i] != char32_t(p_prefix[i]))
+			return false;
+	}
+
+	return true;
+}
+
+// Compiler for @config scripts, which only have a break statement. The tokens of a line are joined with spaces and the lines are joined together, the
+// source is copied straight into one buffer per expression so no String is created until an expression is complete.
+// r_lines gets the source line every expression starts on.
+template <typename T>
+_ALWAYS_INLINE_ void compile_config_script(const T *p_chars, const LocalVector<SourceToken> &p_tokens, PackedStringArray &r_compiled_expressions, PackedInt32Array &r_lines) {
+	LocalVector<T> expr_buffer;
+	for (int line_start = get_line_end(p_tokens, 0); line_start < int(p_tokens.size());) {
+		const int line_end = get_line_end(p_tokens, line_start);
+		const SourceToken &first_token = p_tokens[line_start];
+
+		// Break expression
+		const bool is_break = token_begins_with(first_token, p_chars, "break", 5) or token_begins_with(first_token, p_chars, "---", 3);
+		if (is_break and !expr_buffer.is_empty()) {
+			r_compiled_expressions.append(expression_buffer_to_string(expr_buffer));
+			expr_buffer.clear();
+			line_start = line_end;
+			continue;
+		}
+
+		if (expr_buffer.is_empty())
+			r_lines.append(first_token.line + 1);
+
+		for (int j = line_start; j < line_end; ++j) {
+			if (j > line_start)
+				expr_buffer.push_back(' ');
+
+			const SourceToken &token = p_tokens[j];
+			const int buffer_size = expr_buffer.size();
+			expr_buffer.resize(buffer_size + token.length);
+			memcpy(expr_buffer.ptr() + buffer_size, p_chars + token.offset, token.length * sizeof(T));
+		}
+
+		line_start = line_end;
+	}
+
+	if (!expr_buffer.is_empty())
+		r_compiled_expressions.append(expression_buffer_to_string(expr_buffer));
+}
+
+// The preprocessing stage of the compiler. It runs once over the token stream of a source, removes the define lines and expands every macro, the compiler only
+// ever sees the expanded lines. Macros are C style and only apply to the lines after their define:
+// define NAME value          - Object-like, NAME is replaced with value.
+// define NAME(a, b) a + b    - Function-like, NAME(1, 2) is replaced with 1 + 2.
+// Every identifier is looked up once in a hash table and the result of an expansion is expanded again, a macro is never expanded inside its own expansion.
+class MacroPreprocessor {
+	struct Macro {
+		PackedStringArray parameters;
+		String body;
+		bool is_function_like = false;
+	};
+
+	HashMap<String, Macro> macros;
+	HashSet<String> expanding_macros; // Recursion guard, the macros whose expansion is being expanded.
+	String source_path;
+	LocalVector<SourceToken> line_tokens;
+
+	void define(const PackedStringArray &p_tokens) {
+		ERR_FAIL_COND_MSG(p_tokens.size() < 2, vformat("GDExpr define without a name in %s.", source_path));
+
+		String definition = String(" ").join(p_tokens.slice(1));
+		const char32_t *chars = definition.ptr();
+		int name_end = 0;
+		while (name_end < definition.length() and is_identifier_char(chars[name_end])) {
+			name_end++;
+		}
+
+		const String name = definition.substr(0, name_end);
+		ERR_FAIL_COND_MSG(name.is_empty(), vformat("GDExpr define with an invalid name \"%s\" in %s.", p_tokens[1], source_path));
+
+		Macro macro;
+		if (name_end < definition.length() and chars[name_end] == '(') {
+			const int parameters_end = definition.find(")", name_end);
+			ERR_FAIL_COND_MSG(parameters_end < 0, vformat("GDExpr define %s is missing the ')' closing its parameters in %s.", name, source_path));
+
+			macro.is_function_like = true;
+			const PackedStringArray parameters = definition.substr(name_end + 1, parameters_end - name_end - 1).split(",", false);
+			for (int i = 0; i < parameters.size(); ++i) {
+				macro.parameters.append(parameters[i].strip_edges());
+			}
+			macro.body = definition.substr(parameters_end + 1).strip_edges();
+		} else {
+			// Object-like bodies are joined without spaces, the same as defines always have been.
+			macro.body = String().join(p_tokens.slice(2));
+		}
+
+		macros.insert(name, macro);
+	}
+
+	// Split the arguments of a function-like macro call. p_position is the index of the opening '(' and is moved past the closing ')'.
+	// Returns false if the call is never closed.
+	bool parse_arguments(const String &p_text, int &r_position, PackedStringArray &r_arguments) const {
+		const char32_t *chars = p_text.ptr();
+		const int length = p_text.length();
+		int depth = 0;
+		int argument_start = r_position + 1;
+
+		for (int i = r_position; i < length; ++i) {
+			const char32_t c = chars[i];
+			if (c == '"' or c == '\'') {
+				i++;
+				while (i < length and chars[i] != c) {
+					i += chars[i] == '\\' ? 1 : 0;
+					i++;
+				}
+			} else if (c == '(' or c == '[' or c == '{') {
+				depth++;
+			} else if (c == ')' or c == ']' or c == '}') {
+				depth--;
+				if (depth == 0) {
+					const String argument = p_text.substr(argument_start, i - argument_start).strip_edges();
+					if (!argument.is_empty() or !r_arguments.is_empty())
+						r_arguments.append(argument);
+
+					r_position = i + 1;
+					return true;
+				}
+			} else if (c == ',' and depth == 1) {
+				r_arguments.append(p_text.substr(argument_start, i - argument_start).strip_edges());
+				argument_start = i + 1;
+			}
+		}
+
+		return false;
+	}
+
+	String expand(const String &p_text) {
+		const char32_t *chars = p_text.ptr();
+		const int length = p_text.length();
+		String result;
+		int copied_to = 0;
+
+		int position = 0;
+		int identifier_start = find_next_identifier(chars, length, position);
+		for (; identifier_start >= 0; identifier_start = find_next_identifier(chars, length, position)) {
+			const String name = p_text.substr(identifier_start, position - identifier_start);
+			const Macro *macro = macros.getptr(name);
+			if (macro == nullptr or expanding_macros.has(name))
+				continue;
+
+			String expansion = macro->body;
+			if (macro->is_function_like) {
+				int call_start = position;
+				while (call_start < length and (chars[call_start] == ' ' or chars[call_start] == '\t')) {
+					call_start++;
+				}
+
+				// A function-like macro without arguments is just a name.
+				if (call_start >= length or chars[call_start] != '(')
+					continue;
+
+				PackedStringArray arguments;
+				int call_end = call_start;
+				if (!parse_arguments(p_text, call_end, arguments)) {
+					ERR_PRINT(vformat("GDExpr macro call %s is never closed in %s.", name, source_path));
+					continue;
+				}
+
+				if (arguments.size() != macro->parameters.size()) {
+					ERR_PRINT(vformat("GDExpr macro %s takes %d arguments but got %d in %s.", name, macro->parameters.size(), arguments.size(), source_path));
+					continue;
+				}
+
+				HashMap<String, String> parameter_values;
+				for (int i = 0; i < arguments.size(); ++i) {
+					parameter_values.insert(macro->parameters[i], expand(arguments[i]));
+				}
+
+				expansion = substitute_identifiers(expansion, parameter_values);
+				position = call_end;
+			}
+
+			expanding_macros.insert(name);
+			expansion = expand(expansion);
+			expanding_macros.erase(name);
+
+			result += p_text.substr(copied_to, identifier_start - copied_to) + expansion;
+			copied_to = position;
+		}
+
+		if (copied_to == 0)
+			return p_text;
+
+		return result + p_text.substr(copied_to);
+	}
+
+public:
+	// Returns the tokens of every line of p_source with the define lines removed and every macro expanded.
+	// r_line_numbers gets the source line of every line that is returned.
+	Vector<PackedStringArray> preprocess(const SourceBuffer &p_source, const LocalVector<SourceToken> &p_tokens, PackedInt32Array &r_line_numbers) {
+		source_path = p_source.get_path();
+		Vector<PackedStringArray> lines;
+
+		for (int line_start = 0; line_start < int(p_tokens.size());) {
+			const int line_end = get_line_end(p_tokens, line_start);
+			const int line_number = p_tokens[line_start].line + 1;
+			PackedStringArray tokens = p_source.get_token_strings(p_tokens, line_start, line_end);
+			line_start = line_end;
+
+			if (tokens[0] == String("define")) {
+				define(tokens);
+				continue;
+			}
+
+			// Lines without macros keep their tokens, lines with macros are tokenized again after they are expanded because an expansion can span several tokens.
+			if (!macros.is_empty()) {
+				const String line = String(" ").join(tokens);
+				const String expanded_line = expand(line);
+				if (expanded_line != line) {
+					tokenize_source(expanded_line.ptr(), expanded_line.length(), line_tokens);
+					if (line_tokens.is_empty())
+						continue;
+
+					tokens = SourceBuffer(expanded_line).get_token_strings(line_tokens, 0, line_tokens.size());
 				}
-			} else {
-				current_word += p_string[i];
 			}
+
+			lines.push_back(tokens);
+			r_line_numbers.append(line_number);
+		}
+
+		return lines;
+	}
+};
+
+// Preprocessed lines of files, keyed by their path. A file is only preprocessed again when its content changes, so a file that is included by several
+// scripts or compiled again is only expanded once. Macros never leak out of the file that defines them, so the expansion only depends on the file itself.
+class PreprocessorCache {
+	struct Entry {
+		uint32_t content_hash = 0;
+		Vector<PackedStringArray> lines;
+		PackedInt32Array line_numbers;
+	};
+
+	HashMap<String, Entry> entries;
+	Ref<Mutex> mutex;
+
+public:
+	PreprocessorCache() { mutex.instantiate(); }
+
+	bool get_lines(const String &p_path, uint32_t p_content_hash, Vector<PackedStringArray> &r_lines, PackedInt32Array &r_line_numbers) {
+		MutexLock lock(*mutex.ptr());
+		const Entry *entry = entries.getptr(p_path);
+		if (entry == nullptr or entry->content_hash != p_content_hash)
+			return false;
+
+		r_lines = entry->lines;
+		r_line_numbers = entry->line_numbers;
+		return true;
+	}
+
+	void set_lines(const String &p_path, uint32_t p_content_hash, const Vector<PackedStringArray> &p_lines, const PackedInt32Array &p_line_numbers) {
+		MutexLock lock(*mutex.ptr());
+		Entry entry;
+		entry.content_hash = p_content_hash;
+		entry.lines = p_lines;
+		entry.line_numbers = p_line_numbers;
+		entries.insert(p_path, entry);
+	}
+
+	void clear() {
+		MutexLock lock(*mutex.ptr());
+		entries.clear();
+	}
+};
+
+// Print the error of an expression that failed to execute. Expressions are reported by the file and line they were compiled from when it is known,
+// by their index in the file otherwise, and expressions without a source file by their index alone.
+_ALWAYS_INLINE_ void print_expression_error(const String &p_source_path, int p_index, int p_line, const String &p_expression, const String &p_error) {
+	if (p_line > 0 and !p_source_path.is_empty()) {
+		UtilityFunctions::printerr(vformat("[%s:%d] - ", p_source_path, p_line), "GDExpr expression: \"", p_expression, "\" failed to execute with error: ", p_error);
+	} else if (p_source_path.is_empty()) {
+		UtilityFunctions::printerr(vformat("[%d] - ", p_index + 1), "GDExpr expression: \"", p_expression, "\" failed to execute with error: ", p_error);
+	} else {
+		UtilityFunctions::printerr(vformat("[%s:%d] - ", p_source_path, p_index + 1), "GDExpr expression: \"", p_expression, "\" failed to execute with error: ", p_error);
+	}
+}
+
+// Parses expressions that are nothing but a literal straight into the Variant they evaluate to: numbers, strings, true, false, null, the PI, TAU, INF and NAN
+// constants, vector, rect and color constructors with number arguments, and arrays and dictionaries of literals. Most expressions of @config scripts are
+// like that and the optimizer folds constant expressions into them too, so a program can return them without parsing or executing an Expression.
+// Anything else, a function call, an operator or an identifier, makes parse fail and the expression is left to the Expression engine.
+class LiteralParser {
+	const String *expression = nullptr;
+	const char32_t *chars = nullptr;
+	int length = 0;
+	int position = 0;
+	const PackedStringArray *input_names = nullptr;
+
+	void skip_whitespace() {
+		while (position < length and (chars[position] == ' ' or chars[position] == '\t' or chars[position] == '\n' or chars[position] == '\r')) {
+			position++;
+		}
+	}
+
+	bool consume(char32_t c) {
+		skip_whitespace();
+		if (position >= length or chars[position] != c)
+			return false;
+
+		position++;
+		return true;
+	}
+
+	bool parse_digits() {
+		const int start = position;
+		while (position < length and chars[position] >= '0' and chars[position] <= '9') {
+			position++;
+		}
+
+		return position > start;
+	}
+
+	// Decimal numbers with an optional fraction and exponent, the same as the Expression tokenizer reads them. Hex, binary and other number forms aren't handled.
+	bool parse_number(Variant &r_value) {
+		const int start = position;
+		if (chars[position] == '-')
+			position++;
+
+		if (!parse_digits())
+			return false;
+
+		bool is_float = false;
+		if (position < length and chars[position] == '.') {
+			position++;
+			is_float = true;
+			if (!parse_digits())
+				return false;
+		}
+
+		if (position < length and (chars[position] == 'e' or chars[position] == 'E')) {
+			position++;
+			is_float = true;
+			if (position < length and (chars[position] == '+' or chars[position] == '-'))
+				position++;
+
+			if (!parse_digits())
+				return false;
+		}
+
+		if (position < length and (is_identifier_char(chars[position]) or chars[position] == '.'))
+			return false;
+
+		const String number = expression->substr(start, position - start);
+		if (is_float) {
+			r_value = number.to_float();
+		} else {
+			// Leave numbers that might not fit an int to the Expression engine, it decides what happens to them.
+			if (position - start > 18)
+				return false;
+
+			r_value = number.to_int();
 		}
+
+		return true;
 	}
 
-	if (!current_word.is_empty()) {
-		result += current_word;
+	bool parse_string(Variant &r_value) {
+		const char32_t quote = chars[position++];
+		String value;
+		int copied_to = position;
+		while (position < length and chars[position] != quote) {
+			if (chars[position] != '\\') {
+				position++;
+				continue;
+			}
+
+			if (position + 1 >= length)
+				return false;
+
+			char32_t escaped = 0;
+			switch (chars[position + 1]) {
+				case 'n':
+					escaped = '\n';
+					break;
+				case 't':
+					escaped = '\t';
+					break;
+				case 'r':
+					escaped = '\r';
+					break;
+				case '\\':
+				case '"':
+				case '\'':
+					escaped = chars[position + 1];
+					break;
+				default:
+					return false; // Unicode and the rarer escapes are left to the Expression engine.
+			}
+
+			value += expression->substr(copied_to, position - copied_to) + String::chr(escaped);
+			position += 2;
+			copied_to = position;
+		}
+
+		if (position >= length)
+			return false;
+
+		value += expression->substr(copied_to, position - copied_to);
+		position++;
+		r_value = value;
+		return true;
+	}
+
+	// Parse p_count comma separated numbers followed by ')'. The opening '(' is already consumed.
+	bool parse_number_arguments(int p_count, bool p_integers, double *r_arguments) {
+		for (int i = 0; i < p_count; ++i) {
+			if (i > 0 and !consume(','))
+				return false;
+
+			Variant argument;
+			skip_whitespace();
+			if (position >= length or !parse_number(argument))
+				return false;
+
+			if (p_integers and argument.get_type() != Variant::INT)
+				return false;
+
+			r_arguments[i] = argument;
+		}
+
+		return consume(')');
+	}
+
+	bool parse_constructor(const String &p_type, Variant &r_value) {
+		double arguments[4] = {};
+		if (p_type == "Vector2" or p_type == "Vector2i") {
+			if (!parse_number_arguments(2, p_type == "Vector2i", arguments))
+				return false;
+
+			r_value = p_type == "Vector2" ? Variant(Vector2(arguments[0], arguments[1])) : Variant(Vector2i(int32_t(arguments[0]), int32_t(arguments[1])));
+		} else if (p_type == "Vector3" or p_type == "Vector3i") {
+			if (!parse_number_arguments(3, p_type == "Vector3i", arguments))
+				return false;
+
+			r_value = p_type == "Vector3" ? Variant(Vector3(arguments[0], arguments[1], arguments[2])) : Variant(Vector3i(int32_t(arguments[0]), int32_t(arguments[1]), int32_t(arguments[2])));
+		} else if (p_type == "Vector4" or p_type == "Vector4i") {
+			if (!parse_number_arguments(4, p_type == "Vector4i", arguments))
+				return false;
+
+			r_value = p_type == "Vector4" ? Variant(Vector4(arguments[0], arguments[1], arguments[2], arguments[3]))
+										  : Variant(Vector4i(int32_t(arguments[0]), int32_t(arguments[1]), int32_t(arguments[2]), int32_t(arguments[3])));
+		} else if (p_type == "Rect2" or p_type == "Rect2i") {
+			if (!parse_number_arguments(4, p_type == "Rect2i", arguments))
+				return false;
+
+			r_value = p_type == "Rect2" ? Variant(Rect2(arguments[0], arguments[1], arguments[2], arguments[3]))
+										: Variant(Rect2i(int32_t(arguments[0]), int32_t(arguments[1]), int32_t(arguments[2]), int32_t(arguments[3])));
+		} else if (p_type == "Color") {
+			// Color has a constructor with and without alpha, try the one with alpha first.
+			const int start = position;
+			if (parse_number_arguments(4, false, arguments)) {
+				r_value = Color(arguments[0], arguments[1], arguments[2], arguments[3]);
+			} else {
+				position = start;
+				if (!parse_number_arguments(3, false, arguments))
+					return false;
+
+				r_value = Color(arguments[0], arguments[1], arguments[2]);
+			}
+		} else {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool parse_identifier(Variant &r_value) {
+		const int start = position;
+		while (position < length and is_identifier_char(chars[position])) {
+			position++;
+		}
+
+		const String identifier = expression->substr(start, position - start);
+		// Expression reads true, PI and the other constants before it looks at inputs, so an input named like one is still that constant there. Leaving those
+		// to the Expression engine is just the conservative choice, it gives the same value either way.
+		if (input_names != nullptr and input_names->has(identifier))
+			return false;
+
+		if (consume('('))
+			return parse_constructor(identifier, r_value);
+
+		if (identifier == "true") {
+			r_value = true;
+		} else if (identifier == "false") {
+			r_value = false;
+		} else if (identifier == "null") {
+			r_value = Variant();
+		} else if (identifier == "PI") {
+			r_value = Math_PI;
+		} else if (identifier == "TAU") {
+			r_value = Math_TAU;
+		} else if (identifier == "INF") {
+			r_value = Math_INF;
+		} else if (identifier == "NAN") {
+			r_value = Math_NAN;
+		} else {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool parse_array(Variant &r_value) {
+		position++;
+		Array array;
+		if (consume(']')) {
+			r_value = array;
+			return true;
+		}
+
+		do {
+			Variant element;
+			if (!parse_value(element))
+				return false;
+
+			array.push_back(element);
+		} while (consume(','));
+
+		if (!consume(']'))
+			return false;
+
+		r_value = array;
+		return true;
+	}
+
+	bool parse_dictionary(Variant &r_value) {
+		position++;
+		Dictionary dictionary;
+		if (consume('}')) {
+			r_value = dictionary;
+			return true;
+		}
+
+		do {
+			Variant key;
+			Variant value;
+			if (!parse_value(key) or !consume(':') or !parse_value(value))
+				return false;
+
+			dictionary[key] = value;
+		} while (consume(','));
+
+		if (!consume('}'))
+			return false;
+
+		r_value = dictionary;
+		return true;
+	}
+
+	bool parse_value(Variant &r_value) {
+		skip_whitespace();
+		if (position >= length)
+			return false;
+
+		const char32_t c = chars[position];
+		if ((c >= '0' and c <= '9') or c == '-')
+			return parse_number(r_value);
+
+		if (c == '"' or c == '\'')
+			return parse_string(r_value);
+
+		if (c == '[')
+			return parse_array(r_value);
+
+		if (c == '{')
+			return parse_dictionary(r_value);
+
+		if (is_identifier_start(c))
+			return parse_identifier(r_value);
+
+		return false;
+	}
+
+public:
+	// Parse p_expression into r_value if it is a literal, as if it was parsed with p_input_names. Returns false if it isn't one.
+	bool parse(const String &p_expression, const PackedStringArray &p_input_names, Variant &r_value) {
+		expression = &p_expression;
+		chars = p_expression.ptr();
+		length = p_expression.length();
+		position = 0;
+		input_names = &p_input_names;
+
+		if (!parse_value(r_value))
+			return false;
+
+		skip_whitespace();
+		return position == length;
+	}
+};
+
+// A compiled gdexpr program that owns its compiled godot expressions and their parsed Expression objects.
+// Compile a program once when loading and then execute it as many times as needed, executing a program never compiles or parses anything.
+// Programs are Resources so gdexpr files can be loaded through the ResourceLoader, see GDExprResourceFormatLoader.
+class GDExprProgram : public Resource {
+	GDCLASS(GDExprProgram, Resource)
+
+private:
+	PackedStringArray expressions;
+	Vector<Ref<Expression>> parsed_expressions; // Null for expressions that are a literal, those return their constant value instead.
+	Vector<Variant> constant_values;
+	// Parsed expression sets that no execution is using right now, see take_expressions. Starts out with parsed_expressions.
+	Vector<Vector<Ref<Expression>>> free_expression_sets;
+	Ref<Mutex> mutex;
+	PackedStringArray input_names;
+	PackedStringArray variable_names;
+	String source_path;
+	bool variables_as_inputs = false;
+	SourceMap source_map;
+
+	// Arrays and dictionaries are copied so changing the result of one execution doesn't change the results of the next, the same as a new Expression result.
+	Variant get_constant_value(int p_index) const {
+		const Variant &value = constant_values[p_index];
+		if (value.get_type() == Variant::ARRAY)
+			return Array(value).duplicate(true);
+
+		if (value.get_type() == Variant::DICTIONARY)
+			return Dictionary(value).duplicate(true);
+
+		return value;
+	}
+
+	void print_error(int p_index, const String &p_error) const {
+		const String file = get_expression_file(p_index);
+		print_expression_error(file.is_empty() ? source_path : file, p_index, get_expression_line(p_index), expressions[p_index], p_error);
+	}
+
+protected:
+	static void _bind_methods() {
+		ClassDB::bind_method(D_METHOD("execute", "inputs", "instance"), &GDExprProgram::execute);
+		ClassDB::bind_method(D_METHOD("get_expressions"), &GDExprProgram::get_expressions);
+		ClassDB::bind_method(D_METHOD("get_expression_count"), &GDExprProgram::get_expression_count);
+		ClassDB::bind_method(D_METHOD("get_expression_file", "index"), &GDExprProgram::get_expression_file);
+		ClassDB::bind_method(D_METHOD("get_expression_line", "index"), &GDExprProgram::get_expression_line);
+		ClassDB::bind_method(D_METHOD("get_input_names"), &GDExprProgram::get_input_names);
+		ClassDB::bind_method(D_METHOD("get_source_path"), &GDExprProgram::get_source_path);
+		ClassDB::bind_method(D_METHOD("get_variable_names"), &GDExprProgram::get_variable_names);
+		ClassDB::bind_method(D_METHOD("has_variables_as_inputs"), &GDExprProgram::has_variables_as_inputs);
+	}
+
+public:
+	GDExprProgram() { mutex.instantiate(); }
+
+	// Used by the compiler to fill in the program, p_parsed_expressions must have been parsed from p_expressions with p_input_names.
+	// Expressions that are a literal have no parsed expression, their value is in p_constant_values instead.
+	// p_variable_names are the names of the variable slots in slot order.
+	// If p_variables_as_inputs is true the expressions were parsed with the variable names appended to the input names and read variables as expression inputs.
+	// p_source_map has the file and line of every expression, or nothing if they aren't known.
+	void set_compiled_expressions(const PackedStringArray &p_expressions, const Vector<Ref<Expression>> &p_parsed_expressions, const PackedStringArray &p_input_names,
+			const PackedStringArray &p_variable_names, bool p_variables_as_inputs, const String &p_source_path, const SourceMap &p_source_map,
+			const Vector<Variant> &p_constant_values) {
+		ERR_FAIL_COND(p_expressions.size() != p_parsed_expressions.size() or p_expressions.size() != p_constant_values.size());
+		expressions = p_expressions;
+		parsed_expressions = p_parsed_expressions;
+		constant_values = p_constant_values;
+		free_expression_sets.clear();
+		free_expression_sets.push_back(parsed_expressions);
+		input_names = p_input_names;
+		variable_names = p_variable_names;
+		variables_as_inputs = p_variables_as_inputs;
+		source_path = p_source_path;
+		source_map = p_source_map;
+	}
+
+	// Bind the variable slots of the program on the instance and build the inputs array the expressions are executed with.
+	// Every call must be matched by a call to finish_execution once the expressions are done running.
+	Array begin_execution(const Array &p_inputs, const Ref<GDExprScript> &p_instance) const {
+		if (p_instance.is_valid() and !variable_names.is_empty())
+			p_instance->bind_slots(variable_names);
+
+		if (!variables_as_inputs)
+			return p_inputs;
+
+		// The user inputs come first, followed by one input per variable that set_slot writes into.
+		Array execution_inputs;
+		execution_inputs.resize(input_names.size() + variable_names.size());
+		for (int i = 0; i < input_names.size() and i < p_inputs.size(); ++i) {
+			execution_inputs[i] = p_inputs[i];
+		}
+
+		if (p_instance.is_valid())
+			p_instance->bind_slot_inputs(execution_inputs, input_names.size());
+
+		return execution_inputs;
+	}
+
+	void finish_execution(const Ref<GDExprScript> &p_instance) const {
+		if (variables_as_inputs and p_instance.is_valid())
+			p_instance->unbind_slot_inputs();
+	}
+
+	// An Expression keeps the error of its last execute, so it can't be executed by two threads at once, or again by a function it calls while it is running.
+	// Every execution takes a set of parsed expressions no other execution is using and gives it back once it is done. Only executions that overlap parse
+	// a new set, and that set is kept for the next execution that overlaps.
+	Vector<Ref<Expression>> take_expressions() {
+		{
+			MutexLock lock(*mutex.ptr());
+			if (!free_expression_sets.is_empty()) {
+				Vector<Ref<Expression>> expression_set = free_expression_sets[free_expression_sets.size() - 1];
+				free_expression_sets.remove_at(free_expression_sets.size() - 1);
+				return expression_set;
+			}
+		}
+
+		return parse_expressions();
+	}
+
+	void give_back_expressions(const Vector<Ref<Expression>> &p_expression_set) {
+		MutexLock lock(*mutex.ptr());
+		free_expression_sets.push_back(p_expression_set);
+	}
+
+	// Execute a single expression of the program from a set returned by take_expressions with inputs returned by begin_execution.
+	// Errors are printed and r_failed is set if the expression fails.
+	Variant execute_expression(const Vector<Ref<Expression>> &p_parsed_expressions, int p_index, const Array &p_execution_inputs, const Ref<GDExprScript> &p_instance,
+			bool &r_failed) const {
+		const Ref<Expression> &expression = p_parsed_expressions[p_index];
+		if (expression.is_null()) {
+			r_failed = false;
+			return get_constant_value(p_index);
+		}
+
+		Variant result = expression->execute(p_execution_inputs, *p_instance);
+
+		r_failed = expression->has_execute_failed();
+		if (r_failed) {
+			print_error(p_index, expression->get_error_text());
+			return Variant();
+		}
+
+#ifdef GDEXPR_COMPILER_DEBUG
+		UtilityFunctions::print("EXPR TO PARSE: ", expressions[p_index]);
+		UtilityFunctions::print("EXPR RESULT: ", result);
+#endif
+
+		return result;
+	}
+
+	// Execute every expression in the program with the inputs matching the programs input names and the script instance functions will be called on.
+	// Returns the results of each expression executed in an Array.
+	Array execute(Array inputs, Ref<GDExprScript> instance) {
+#ifdef GDEXPR_COMPILER_TIMING_DEBUG
+		TIME_START(gdexpr_execution)
+#endif
+
+		Array execution_inputs = begin_execution(inputs, instance);
+		const Vector<Ref<Expression>> expression_set = take_expressions();
+
+		Array results;
+		for (int i = 0; i < expression_set.size(); ++i) {
+			bool has_failed = false;
+			Variant result = execute_expression(expression_set, i, execution_inputs, instance, has_failed);
+			if (!has_failed)
+				results.push_back(result);
+		}
+
+		give_back_expressions(expression_set);
+		finish_execution(instance);
+
+#ifdef GDEXPR_COMPILER_TIMING_DEBUG
+		TIME_MICRO_END(gdexpr_execution)
+#endif
+		return results;
+	}
+
+	// The input names the expressions of the program are parsed with.
+	PackedStringArray get_parse_input_names() const {
+		PackedStringArray parse_input_names = input_names;
+		if (variables_as_inputs)
+			parse_input_names.append_array(variable_names);
+
+		return parse_input_names;
+	}
+
+	// Parse a new set of the programs expressions. An Expression can't be executed by several threads at once, so every thread running the program needs its own set.
+	Vector<Ref<Expression>> parse_expressions() const {
+		PackedStringArray parse_input_names = get_parse_input_names();
+		Vector<Ref<Expression>> new_parsed_expressions;
+		new_parsed_expressions.resize(expressions.size());
+		for (int i = 0; i < expressions.size(); ++i) {
+			if (parsed_expressions[i].is_null())
+				continue;
+
+			Ref<Expression> expression;
+			expression.instantiate();
+			expression->parse(expressions[i], parse_input_names);
+			new_parsed_expressions.write[i] = expression;
+		}
+
+		return new_parsed_expressions;
+	}
+
+	// Run the program for a single context of a batch using p_parsed_expressions and write the result of every expression into r_results.
+	// The result of an expression that failed is left untouched.
+	void execute_context(const Vector<Ref<Expression>> &p_parsed_expressions, const Array &p_inputs, const Ref<GDExprScript> &p_context, Variant *r_results) const {
+		Array execution_inputs = begin_execution(p_inputs, p_context);
+
+		for (int i = 0; i < p_parsed_expressions.size(); ++i) {
+			const Ref<Expression> &expression = p_parsed_expressions[i];
+			if (expression.is_null()) {
+				r_results[i] = get_constant_value(i);
+				continue;
+			}
+
+			Variant result = expression->execute(execution_inputs, *p_context);
+
+			if (expression->has_execute_failed()) {
+				print_error(i, expression->get_error_text());
+				continue;
+			}
+
+			r_results[i] = result;
+		}
+
+		finish_execution(p_context);
+	}
+
+	// Turn batch results stored as one row of expression results per context into one Array per expression index.
+	Array get_batch_results(const Vector<Variant> &p_result_rows, int p_context_count) const {
+		const int expression_count = expressions.size();
+		Array results;
+		results.resize(expression_count);
+		for (int i = 0; i < expression_count; ++i) {
+			Array column;
+			column.resize(p_context_count);
+			for (int context_index = 0; context_index < p_context_count; ++context_index) {
+				column[context_index] = p_result_rows[context_index * expression_count + i];
+			}
+			results[i] = column;
+		}
+
+		return results;
+	}
+
+	// Execute the program once for every context. p_inputs_per_context is either empty or holds the inputs Array for each context.
+	// Returns one Array per expression index holding the result of that expression for every context, in context order.
+	// Unlike execute the result of an expression that failed is null instead of being skipped, so the results of every context line up.
+	Array execute_batch(const TypedArray<GDExprScript> &p_contexts, const Array &p_inputs_per_context) {
+		const int context_count = p_contexts.size();
+		ERR_FAIL_COND_V_MSG(!p_inputs_per_context.is_empty() and p_inputs_per_context.size() != context_count, Array(),
+				"GDExpr batch execution needs either no inputs or one inputs Array per context.");
+
+		Vector<Variant> result_rows;
+		result_rows.resize(context_count * expressions.size());
+		Variant *result_rows_ptr = result_rows.ptrw();
+
+		const Vector<Ref<Expression>> expression_set = take_expressions();
+		for (int context_index = 0; context_index < context_count; ++context_index) {
+			Array inputs = p_inputs_per_context.is_empty() ? Array() : Array(p_inputs_per_context[context_index]);
+			execute_context(expression_set, inputs, p_contexts[context_index], result_rows_ptr + context_index * expressions.size());
+		}
+		give_back_expressions(expression_set);
+
+		return get_batch_results(result_rows, context_count);
+	}
+
+	PackedStringArray get_expressions() const { return expressions; }
+	int get_expression_count() const { return expressions.size(); }
+	PackedStringArray get_input_names() const { return input_names; }
+	PackedStringArray get_variable_names() const { return variable_names; }
+	bool has_variables_as_inputs() const { return variables_as_inputs; }
+	String get_source_path() const { return source_path; }
+	const SourceMap &get_source_map() const { return source_map; }
+
+	// Everything the program is made of except its parsed expressions, which can always be parsed again from it.
+	CompiledProgramData get_program_data() const {
+		CompiledProgramData program_data;
+		program_data.expressions = expressions;
+		program_data.input_names = input_names;
+		program_data.variable_names = variable_names;
+		program_data.source_path = source_path;
+		program_data.variables_as_inputs = variables_as_inputs;
+		program_data.source_map = source_map;
+		return program_data;
+	}
+
+	// The file the expression at p_index was compiled from, an include has its own file. Empty if it isn't known.
+	String get_expression_file(int p_index) const { return p_index >= 0 and p_index < source_map.size() ? source_map.files[p_index] : String(); }
+
+	// The line the expression at p_index starts on in its file, or 0 if it isn't known.
+	int get_expression_line(int p_index) const { return p_index >= 0 and p_index < source_map.size() ? source_map.lines[p_index] : 0; }
+};
+
+// A resumable execution of a GDExprProgram. Every call to step runs expressions until its budget is spent and the next call picks up where the last one stopped,
+// so a long program can be spread over several frames instead of stalling one.
+class GDExprExecution : public RefCounted {
+	GDCLASS(GDExprExecution, RefCounted)
+
+private:
+	Ref<GDExprProgram> program;
+	Array inputs;
+	Ref<GDExprScript> instance;
+	Array results;
+	int next_expression = 0;
+
+protected:
+	static void _bind_methods() {
+		ClassDB::bind_method(D_METHOD("step", "budget_usec", "max_expressions"), &GDExprExecution::step, DEFVAL(0));
+		ClassDB::bind_method(D_METHOD("is_finished"), &GDExprExecution::is_finished);
+		ClassDB::bind_method(D_METHOD("get_next_expression"), &GDExprExecution::get_next_expression);
+		ClassDB::bind_method(D_METHOD("get_program"), &GDExprExecution::get_program);
+		ClassDB::bind_method(D_METHOD("get_results"), &GDExprExecution::get_results);
+
+		ADD_SIGNAL(MethodInfo("finished", PropertyInfo(Variant::ARRAY, "results")));
+	}
+
+public:
+	GDExprExecution() {}
+
+	void setup(const Ref<GDExprProgram> &p_program, const Array &p_inputs, const Ref<GDExprScript> &p_instance) {
+		program = p_program;
+		inputs = p_inputs;
+		instance = p_instance;
+		results.clear();
+		next_expression = 0;
+	}
+
+	// Run expressions until budget_usec microseconds have passed or max_expressions expressions have run, a budget of 0 or less means no limit.
+	// At least one expression runs on every call so the execution always makes progress. The finished signal is emitted by the step that runs the last expression.
+	// The slots are bound again on every step, so other programs can use the same instance in between steps.
+	// Returns true once every expression has been executed.
+	bool step(int64_t budget_usec, int max_expressions = 0) {
+		ERR_FAIL_COND_V(program.is_null(), true);
+		const int expression_count = program->get_expression_count();
+		if (next_expression >= expression_count)
+			return true;
+
+		const uint64_t start_time = Time::get_singleton()->get_ticks_usec();
+		Array execution_inputs = program->begin_execution(inputs, instance);
+		const Vector<Ref<Expression>> expression_set = program->take_expressions();
+
+		int executed_expressions = 0;
+		while (next_expression < expression_count) {
+			bool has_failed = false;
+			Variant result = program->execute_expression(expression_set, next_expression, execution_inputs, instance, has_failed);
+			if (!has_failed)
+				results.push_back(result);
+
+			next_expression++;
+			executed_expressions++;
+
+			if (max_expressions > 0 and executed_expressions >= max_expressions)
+				break;
+
+			if (budget_usec > 0 and int64_t(Time::get_singleton()->get_ticks_usec() - start_time) >= budget_usec)
+				break;
+		}
+
+		program->give_back_expressions(expression_set);
+		program->finish_execution(instance);
+
+		if (next_expression < expression_count)
+			return false;
+
+		emit_signal("finished", results);
+		return true;
+	}
+
+	bool is_finished() const { return program.is_null() or next_expression >= program->get_expression_count(); }
+
+	// Index of the expression the next step starts at.
+	int get_next_expression() const { return next_expression; }
+
+	Ref<GDExprProgram> get_program() const { return program; }
+
+	// Results of the expressions executed so far, the same as GDExprProgram.execute returns once the execution is finished.
+	Array get_results() const { return results; }
+};
+
+// Shared state of a batch executed in parallel on the WorkerThreadPool. Every element of the group task runs one chunk of grain_size contexts.
+class GDExprBatchTask : public RefCounted {
+	GDCLASS(GDExprBatchTask, RefCounted)
+
+private:
+	Ref<GDExprProgram> program;
+	TypedArray<GDExprScript> contexts;
+	Array inputs_per_context;
+	int grain_size = 1;
+
+	// One row of expression results per context, each chunk only writes the rows of its own contexts so the results are in context order no matter which thread ran them.
+	Vector<Variant> result_rows;
+	Variant *result_rows_ptr = nullptr;
+
+	// Parsed expression sets that no thread is using right now. A chunk takes a free set, or parses a new one if there are none, and gives it back when it is done.
+	// This way the program is parsed at most once for every thread taking part in the batch.
+	Vector<Vector<Ref<Expression>>> free_expression_sets;
+	Ref<Mutex> mutex;
+
+protected:
+	static void _bind_methods() {}
+
+public:
+	GDExprBatchTask() { mutex.instantiate(); }
+
+	void setup(const Ref<GDExprProgram> &p_program, const TypedArray<GDExprScript> &p_contexts, const Array &p_inputs_per_context, int p_grain_size) {
+		program = p_program;
+		contexts = p_contexts;
+		inputs_per_context = p_inputs_per_context;
+		grain_size = MAX(p_grain_size, 1);
+
+		result_rows.resize(contexts.size() * program->get_expression_count());
+		result_rows_ptr = result_rows.ptrw();
+	}
+
+	int get_chunk_count() const { return (contexts.size() + grain_size - 1) / grain_size; }
+
+	void run_chunk(uint32_t p_chunk) {
+		Vector<Ref<Expression>> parsed_expressions;
+		mutex->lock();
+		if (!free_expression_sets.is_empty()) {
+			parsed_expressions = free_expression_sets[free_expression_sets.size() - 1];
+			free_expression_sets.remove_at(free_expression_sets.size() - 1);
+		}
+		mutex->unlock();
+
+		if (parsed_expressions.is_empty())
+			parsed_expressions = program->parse_expressions();
+
+		const int expression_count = program->get_expression_count();
+		const int chunk_end = MIN(int(p_chunk + 1) * grain_size, int(contexts.size()));
+		for (int context_index = p_chunk * grain_size; context_index < chunk_end; ++context_index) {
+			Array inputs = inputs_per_context.is_empty() ? Array() : Array(inputs_per_context[context_index]);
+			program->execute_context(parsed_expressions, inputs, contexts[context_index], result_rows_ptr + context_index * expression_count);
+		}
+
+		mutex->lock();
+		free_expression_sets.push_back(parsed_expressions);
+		mutex->unlock();
+	}
+
+	Array get_results() const { return program->get_batch_results(result_rows, contexts.size()); }
+};
+
+class GDExpr;
+
+// A gdexpr file being compiled to a GDExprProgram on the WorkerThreadPool, created with GDExpr.compile_program_async.
+// Poll it with is_completed, block on it with wait_for_completion or connect to the completed signal, which is emitted on the main thread.
+class GDExprCompileTask : public RefCounted {
+	GDCLASS(GDExprCompileTask, RefCounted)
+
+private:
+	Ref<GDExpr> compiler; // Held so the compiler outlives the compile even if the caller drops its last reference to it.
+	Array inputs;
+	Ref<GDExprScript> instance;
+	String source_path;
+	PackedStringArray input_names;
+
+	Ref<GDExprProgram> program;
+	Ref<GDExprCompileTask> self_reference; // Keeps the task alive while a worker thread is using it, even if nothing else holds on to it.
+	Ref<Mutex> mutex; // Guards task_id, wait_for_completion can be called from any thread while the main thread finishes the task.
+	int64_t task_id = -1;
+
+	void run();
+
+	// Deferred by run, so completed is always emitted on the main thread and only once.
+	void finish_on_main_thread() {
+		wait_for_completion();
+
+		Ref<GDExprCompileTask> self = self_reference; // Dropping the self reference can free the task, so it is released when this function returns.
+		self_reference.unref();
+		self->emit_signal("completed", program);
+	}
+
+protected:
+	static void _bind_methods() {
+		ClassDB::bind_method(D_METHOD("is_completed"), &GDExprCompileTask::is_completed);
+		ClassDB::bind_method(D_METHOD("get_program"), &GDExprCompileTask::get_program);
+		ClassDB::bind_method(D_METHOD("get_source_path"), &GDExprCompileTask::get_source_path);
+		ClassDB::bind_method(D_METHOD("wait_for_completion"), &GDExprCompileTask::wait_for_completion);
+
+		ADD_SIGNAL(MethodInfo("completed", PropertyInfo(Variant::OBJECT, "program")));
+	}
+
+public:
+	GDExprCompileTask() { mutex.instantiate(); }
+
+	void start(const Ref<GDExpr> &p_compiler, const Array &p_inputs, const Ref<GDExprScript> &p_instance, const String &p_source_path,
+			const PackedStringArray &p_input_names) {
+		MutexLock lock(*mutex.ptr());
+		ERR_FAIL_COND(task_id >= 0 or self_reference.is_valid());
+		compiler = p_compiler;
+		inputs = p_inputs;
+		instance = p_instance;
+		source_path = p_source_path;
+		input_names = p_input_names;
+
+		self_reference = Ref<GDExprCompileTask>(this);
+		task_id = WorkerThreadPool::get_singleton()->add_task(callable_mp(this, &GDExprCompileTask::run), false, "GDExpr compile " + source_path);
+	}
+
+	bool is_completed() const {
+		MutexLock lock(*mutex.ptr());
+		return task_id < 0 or WorkerThreadPool::get_singleton()->is_task_completed(task_id);
+	}
+
+	// Block until the program is compiled and return it. Safe to call from any thread, the completed signal is still emitted on the main thread.
+	Ref<GDExprProgram> wait_for_completion() {
+		// The lock is held while waiting so the pool task is only ever waited on once, other callers block here until it is done.
+		MutexLock lock(*mutex.ptr());
+		if (task_id >= 0) {
+			WorkerThreadPool::get_singleton()->wait_for_task_completion(task_id);
+			task_id = -1;
+		}
+
+		return program;
+	}
+
+	// The compiled program, or null if it isn't compiled yet.
+	Ref<GDExprProgram> get_program() { return is_completed() ? wait_for_completion() : Ref<GDExprProgram>(); }
+
+	String get_source_path() const { return source_path; }
+};
+
+// Compiles every gdexpr file of a directory on its own, in parallel on the WorkerThreadPool when GDExpr.parallel_directory_compile is enabled. Every file only
+// writes its own entry so the results are in file order no matter which thread compiled them, GDExpr links them into one program once they are all done.
+class GDExprDirectoryTask : public RefCounted {
+	GDCLASS(GDExprDirectoryTask, RefCounted)
+
+private:
+	Ref<GDExpr> compiler;
+	Array inputs;
+	Ref<GDExprScript> instance;
+	bool variables_as_inputs = false;
+	bool optimize = false;
+	PackedStringArray file_paths;
+
+	Vector<PackedStringArray> file_expressions;
+	Vector<PackedStringArray> file_variable_names; // The slot names of every file, each file numbers its slots from 0.
+	Vector<SourceMap> file_source_maps;
+	PackedStringArray *file_expressions_ptr = nullptr;
+	PackedStringArray *file_variable_names_ptr = nullptr;
+	SourceMap *file_source_maps_ptr = nullptr;
+
+protected:
+	static void _bind_methods() {}
+
+public:
+	GDExprDirectoryTask() {}
+
+	void setup(const Ref<GDExpr> &p_compiler, const Array &p_inputs, const Ref<GDExprScript> &p_instance, bool p_variables_as_inputs, bool p_optimize,
+			const PackedStringArray &p_file_paths) {
+		compiler = p_compiler;
+		inputs = p_inputs;
+		instance = p_instance;
+		variables_as_inputs = p_variables_as_inputs;
+		optimize = p_optimize;
+		file_paths = p_file_paths;
+
+		file_expressions.resize(file_paths.size());
+		file_variable_names.resize(file_paths.size());
+		file_source_maps.resize(file_paths.size());
+		file_expressions_ptr = file_expressions.ptrw();
+		file_variable_names_ptr = file_variable_names.ptrw();
+		file_source_maps_ptr = file_source_maps.ptrw();
+	}
+
+	int get_file_count() const { return file_paths.size(); }
+
+	void compile_file(uint32_t p_file);
+
+	const PackedStringArray &get_file_expressions(int p_file) const { return file_expressions[p_file]; }
+
+	const PackedStringArray &get_file_variable_names(int p_file) const { return file_variable_names[p_file]; }
+
+	const SourceMap &get_file_source_map(int p_file) const { return file_source_maps[p_file]; }
+};
+
+// A bundle of compiled programs in one .gdexprb file, built with GDExpr.build_bundle and opened with GDExpr.open_bundle. Opening a bundle only reads its index,
+// every program is read, decompressed and parsed the first time it is used and the same program is returned after that.
+class GDExprBundle : public RefCounted {
+	GDCLASS(GDExprBundle, RefCounted)
+
+private:
+	Ref<FileAccess> file;
+	String bundle_path;
+	LocalVector<BundleEntry> entries;
+	HashMap<String, Ref<GDExprProgram>> loaded_programs;
+	Ref<Mutex> mutex; // Programs can be loaded from several threads at once and they all read from the same file.
+
+protected:
+	static void _bind_methods() {
+		ClassDB::bind_method(D_METHOD("get_bundle_path"), &GDExprBundle::get_bundle_path);
+		ClassDB::bind_method(D_METHOD("get_paths"), &GDExprBundle::get_paths);
+		ClassDB::bind_method(D_METHOD("has_program", "path"), &GDExprBundle::has_program);
+		ClassDB::bind_method(D_METHOD("load_program", "path"), &GDExprBundle::load_program);
+		ClassDB::bind_method(D_METHOD("execute_program", "path", "inputs", "instance"), &GDExprBundle::execute_program, DEFVAL(Array()), DEFVAL(Variant()));
+	}
+
+public:
+	GDExprBundle() { mutex.instantiate(); }
+
+	Error open(const String &p_path) {
+		file = FileAccess::open(p_path, FileAccess::READ);
+		ERR_FAIL_COND_V_MSG(file.is_null(), FileAccess::get_open_error(), vformat("GDExpr can't open bundle \"%s\".", p_path));
+		bundle_path = p_path;
+
+		const PackedByteArray header = file->get_buffer(BundleFormat::HEADER_SIZE);
+		const int64_t index_size = BundleFormat::get_index_size(header);
+		ERR_FAIL_COND_V_MSG(index_size < 0, ERR_FILE_UNRECOGNIZED, vformat("\"%s\" isn't a gdexpr bundle of this version.", p_path));
+		// The index size comes from the file, check it against the file before reading so a corrupt header can't make it allocate more than the file holds.
+		ERR_FAIL_COND_V_MSG(uint64_t(BundleFormat::HEADER_SIZE + index_size) > file->get_length(), ERR_FILE_CORRUPT, vformat("GDExpr bundle \"%s\" is corrupt.", p_path));
+		ERR_FAIL_COND_V_MSG(!BundleFormat::decode_index(header, file->get_buffer(index_size), file->get_length(), entries), ERR_FILE_CORRUPT,
+				vformat("GDExpr bundle \"%s\" is corrupt.", p_path));
+
+		return OK;
+	}
+
+	String get_bundle_path() const { return bundle_path; }
+
+	// The paths of the programs in the bundle, relative to the directory it was built from.
+	PackedStringArray get_paths() const {
+		PackedStringArray paths;
+		for (uint32_t i = 0; i < entries.size(); ++i) {
+			paths.append(entries[i].path);
+		}
+
+		paths.sort();
+		return paths;
+	}
+
+	bool has_program(const String &p_path) const { return BundleFormat::find_entry(entries, p_path) >= 0; }
+
+	// Read and decompress the program at p_path. Returns false if the bundle has no program at p_path or it is corrupt.
+	bool read_program_data(const String &p_path, CompiledProgramData &r_program_data) {
+		const int entry_index = BundleFormat::find_entry(entries, p_path);
+		if (entry_index < 0)
+			return false;
+
+		const BundleEntry &entry = entries[entry_index];
+		PackedByteArray data;
+		{
+			MutexLock lock(*mutex.ptr());
+			file->seek(entry.offset);
+			data = file->get_buffer(entry.size);
+		}
+
+		if (entry.compression_mode >= 0)
+			data = data.decompress(entry.decompressed_size, entry.compression_mode);
+
+		return CompiledProgramFormat::decode(data, r_program_data);
+	}
+
+	Ref<GDExprProgram> load_program(const String &p_path);
+
+	Array execute_program(const String &p_path, const Array &p_inputs, const Ref<GDExprScript> &p_instance) {
+		Ref<GDExprProgram> program = load_program(p_path);
+		ERR_FAIL_COND_V(program.is_null(), Array());
+		return program->execute(p_inputs, p_instance);
+	}
+};
+
+// The compiled output of an include and everything compiling it changed in the compile context, so including it again can replay it instead of compiling it.
+struct CompiledInclude {
+	PackedStringArray expressions;
+	PackedStringArray declared_variables; // New variables in declaration order, they get the same slots again when the include is replayed on the same slot layout.
+	Dictionary comptime_variables; // Comptime variables the include set.
+	HashMap<String, uint32_t> included_file_hashes; // The include itself and every file it included.
+	bool has_executed_comptime_code = false;
+	SourceMap source_map;
+};
+
+// Compiled includes shared by every compile. Only includes that didn't execute comptime code are shared, since comptime code depends on the inputs and
+// instance of a compile. Entries are keyed by the include and the environment it was compiled in, see GDExpr::get_include_key.
+class IncludeCache {
+	HashMap<String, CompiledInclude> entries;
+	int max_size = 4096;
+	Ref<Mutex> mutex; // Files can be compiled on several threads at once.
+
+public:
+	IncludeCache() { mutex.instantiate(); }
+
+	bool get(const String &p_key, CompiledInclude &r_include) {
+		MutexLock lock(*mutex.ptr());
+		const CompiledInclude *include = entries.getptr(p_key);
+		if (include == nullptr)
+			return false;
+
+		r_include = *include;
+		return true;
+	}
+
+	void set(const String &p_key, const CompiledInclude &p_include) {
+		MutexLock lock(*mutex.ptr());
+		// Every slot layout an include is compiled with gets its own entry, don't let them pile up forever.
+		if (int(entries.size()) >= max_size)
+			entries.clear();
+
+		entries.insert(p_key, p_include);
+	}
+
+	void clear() {
+		MutexLock lock(*mutex.ptr());
+		entries.clear();
+	}
+};
+
+// All the state of a single compiler invocation. Every compile gets its own context so the compiler is reentrant.
+// A comptime function can call into GDExpr while a compile is running and several threads can compile at once.
+struct CompileContext {
+	Ref<GDExprScript> base_instance;
+	Array expression_inputs;
+	String file_to_compile;
+	HashMap<String, int> variable_slots;
+	PackedStringArray variable_slot_names;
+	HashMap<String, String> variable_reads; // What each variable name is replaced with when it is read, empty when variables are read as expression inputs.
+	Dictionary comptime_variables;
+	HashMap<String, String> comptime_variable_text; // The values of comptime_variables as the text they are replaced with.
+	HashSet<String> current_includes;
+	int current_variable_slot = -1;
+	String current_variable_value;
+	Array conditional_stack;
+	bool is_inside_multiline_declaration = false;
+	bool is_inside_condition = false;
+	bool variables_as_inputs = false;
+	bool named_variables = false; // Variables are read and written by name with get_var and set_var instead of slots, for expressions that don't carry their slot names.
+	bool optimize = false;
+	bool has_executed_comptime_code = false; // The compiled expressions depend on the inputs and instance, not just on the source.
+	uint32_t source_hash = 0; // Content hash of the file being compiled.
+	HashMap<String, CompiledInclude> compiled_includes; // Every include compiled so far, an include that is included again is replayed from here.
+	SourceMap source_map; // File and line of every expression compiled so far, see GDExpr::compile.
+	HashMap<String, uint32_t> included_file_hashes; // Content hash of every file included while compiling, including the includes of includes.
+	Ref<Expression> comptime_expression; // Comptime expressions are parsed and executed with the contexts own Expression.
+
+	CompileContext(const Array &p_expression_inputs, const Ref<GDExprScript> &p_base_instance, const String &p_file_to_compile, bool p_variables_as_inputs,
+			bool p_optimize = false) :
+			base_instance(p_base_instance),
+			expression_inputs(p_expression_inputs),
+			file_to_compile(p_file_to_compile),
+			variables_as_inputs(p_variables_as_inputs),
+			optimize(p_optimize) {
+		comptime_expression.instantiate();
+	}
+};
+
+// Keeps track of the files every program compiled from a file depends on, so programs can be reloaded when their file or one of its includes changes.
+// Every file is recorded with its modified time and content hash, a file only counts as changed if its content changed. Includes point back to the source
+// files that included them, so a change to an include only affects the programs that actually include it.
+class ChangeTracker {
+	struct TrackedFile {
+		uint64_t modified_time = 0;
+		uint32_t content_hash = 0;
+	};
+
+	struct TrackedProgram {
+		String source_path;
+		Array inputs;
+		Ref<GDExprScript> instance;
+		PackedStringArray input_names;
+		bool has_changed = false;
+	};
+
+	HashMap<String, TrackedFile> files;
+	HashMap<String, HashSet<String>> dependents; // Every tracked file and the source files that depend on it, a source file depends on itself.
+	HashMap<uint64_t, TrackedProgram> programs; // Keyed by the ObjectID of the program so tracking a program doesn't keep it alive.
+	Ref<Mutex> mutex; // Programs can be compiled on several threads at once.
+
+	void track_file(const String &p_path, uint32_t p_content_hash, const String &p_source_path) {
+		TrackedFile file;
+		file.modified_time = FileAccess::get_modified_time(p_path);
+		file.content_hash = p_content_hash;
+		files.insert(p_path, file);
+
+		if (!dependents.has(p_path))
+			dependents.insert(p_path, HashSet<String>());
+		dependents[p_path].insert(p_source_path);
+	}
+
+	void forget_freed_programs() {
+		LocalVector<uint64_t> freed_programs;
+		for (const KeyValue<uint64_t, TrackedProgram> &E : programs) {
+			if (ObjectDB::get_instance(ObjectID(E.key)) == nullptr)
+				freed_programs.push_back(E.key);
+		}
+
+		for (uint64_t program_id : freed_programs) {
+			programs.erase(program_id);
+		}
+	}
+
+public:
+	ChangeTracker() { mutex.instantiate(); }
+
+	// Record a program that was just compiled from a file with everything needed to compile it again.
+	void track_program(const Ref<GDExprProgram> &p_program, const CompileContext &ctx, const PackedStringArray &p_input_names) {
+		MutexLock lock(*mutex.ptr());
+		// Tracked programs hold on to their inputs and instance, so the ones that were freed are dropped whenever a new one comes in.
+		forget_freed_programs();
+
+		const String &source_path = p_program->get_source_path();
+		track_file(source_path, ctx.source_hash, source_path);
+		for (const KeyValue<String, uint32_t> &E : ctx.included_file_hashes) {
+			track_file(E.key, E.value, source_path);
+		}
+
+		TrackedProgram program;
+		program.source_path = source_path;
+		program.inputs = ctx.expression_inputs;
+		program.instance = ctx.base_instance;
+		program.input_names = p_input_names;
+		programs.insert(p_program->get_instance_id(), program);
+	}
+
+	// Check every tracked file for changes since the last check, the programs depending on a changed file are marked as changed.
+	// Only files with a different modified time are read again. Returns the paths of the files that changed.
+	PackedStringArray check_for_changes() {
+		MutexLock lock(*mutex.ptr());
+		PackedStringArray changed_files;
+		HashSet<String> changed_sources;
+		for (KeyValue<String, TrackedFile> &E : files) {
+			const uint64_t modified_time = FileAccess::get_modified_time(E.key);
+			if (modified_time == E.value.modified_time)
+				continue;
+
+			E.value.modified_time = modified_time;
+			const uint32_t content_hash = SourceBuffer(FileAccess::get_file_as_bytes(E.key)).get_content_hash();
+			if (content_hash == E.value.content_hash)
+				continue;
+
+			E.value.content_hash = content_hash;
+			changed_files.append(E.key);
+			for (const String &source_path : dependents[E.key]) {
+				changed_sources.insert(source_path);
+			}
+		}
+
+		if (changed_sources.is_empty())
+			return changed_files;
+
+		for (KeyValue<uint64_t, TrackedProgram> &E : programs) {
+			if (changed_sources.has(E.value.source_path))
+				E.value.has_changed = true;
+		}
+
+		return changed_files;
+	}
+
+	// Returns every program that is still alive and was marked as changed. Programs that were freed are forgotten.
+	Array get_changed_programs() {
+		MutexLock lock(*mutex.ptr());
+		forget_freed_programs();
+
+		Array changed_programs;
+		for (const KeyValue<uint64_t, TrackedProgram> &E : programs) {
+			GDExprProgram *program = Object::cast_to<GDExprProgram>(ObjectDB::get_instance(ObjectID(E.key)));
+			if (program != nullptr and E.value.has_changed)
+				changed_programs.append(Ref<GDExprProgram>(program));
+		}
+
+		return changed_programs;
+	}
+
+	// Returns false if p_program isn't tracked.
+	bool get_program_info(const Ref<GDExprProgram> &p_program, Array &r_inputs, Ref<GDExprScript> &r_instance, PackedStringArray &r_input_names) {
+		MutexLock lock(*mutex.ptr());
+		const TrackedProgram *program = programs.getptr(p_program->get_instance_id());
+		if (program == nullptr)
+			return false;
+
+		r_inputs = program->inputs;
+		r_instance = program->instance;
+		r_input_names = program->input_names;
+		return true;
+	}
+
+	void clear() {
+		MutexLock lock(*mutex.ptr());
+		files.clear();
+		dependents.clear();
+		programs.clear();
+	}
+};
+
+// Compiled expressions stored on disk, so a file that didn't change since it was last compiled is never lexed, preprocessed or compiled again.
+// An entry is only used if the file, every file it included, the compiler version and the compile settings all match the ones it was compiled with.
+// Files that executed comptime code are never stored. Their output depends on whatever the comptime functions returned, the state of the instance, random numbers
+// or the time, and none of that can be part of the key.
+class CompileCache {
+	String directory = "user://gdexpr_cache";
+	Ref<Mutex> mutex; // Files can be compiled on several threads at once.
+
+	String get_entry_path(const String &p_source_path) const { return directory.path_join(p_source_path.md5_text() + ".cache"); }
+
+	static String get_settings_key(const CompileContext &ctx) { return vformat("%d:%d:%d", ctx.variables_as_inputs, ctx.named_variables, ctx.optimize); }
+
+public:
+	CompileCache() { mutex.instantiate(); }
+
+	void set_directory(const String &p_directory) { directory = p_directory; }
+	String get_directory() const { return directory; }
+
+	// Load the compiled expressions of p_source into r_compiled_expressions and its variables into ctx. Returns false if there is no valid entry for it.
+	bool load(CompileContext &ctx, const SourceBuffer &p_source, PackedStringArray &r_compiled_expressions) {
+		const String entry_path = get_entry_path(p_source.get_path());
+		MutexLock lock(*mutex.ptr());
+		if (!FileAccess::file_exists(entry_path))
+			return false;
+
+		Ref<FileAccess> file = FileAccess::open(entry_path, FileAccess::READ);
+		if (file.is_null())
+			return false;
+
+		const Dictionary entry = file->get_var();
+		if (int(entry.get("version", -1)) != GDEXPR_COMPILER_VERSION or int64_t(entry.get("source_hash", -1)) != int64_t(p_source.get_content_hash()) or
+				String(entry.get("settings", String())) != get_settings_key(ctx))
+			return false;
+
+		// Older entries of files that executed comptime code.
+		if (!String(entry.get("comptime_key", String())).is_empty())
+			return false;
+
+		const Dictionary include_hashes = entry.get("includes", Dictionary());
+		const Array include_paths = include_hashes.keys();
+		for (int i = 0; i < include_paths.size(); ++i) {
+			const String include_path = include_paths[i];
+			if (int64_t(include_hashes[include_path]) != int64_t(SourceBuffer(FileAccess::get_file_as_bytes(include_path)).get_content_hash()))
+				return false;
+		}
+
+		for (int i = 0; i < include_paths.size(); ++i) {
+			ctx.included_file_hashes.insert(include_paths[i], uint32_t(int64_t(include_hashes[include_paths[i]])));
+		}
+
+		r_compiled_expressions = entry.get("expressions", PackedStringArray());
+		ctx.source_map.files = entry.get("source_files", PackedStringArray());
+		ctx.source_map.lines = entry.get("source_lines", PackedInt32Array());
+		ctx.variable_slot_names = entry.get("variable_names", PackedStringArray());
+		ctx.variable_slots.clear();
+		for (int i = 0; i < ctx.variable_slot_names.size(); ++i) {
+			ctx.variable_slots.insert(ctx.variable_slot_names[i], i);
+		}
+
+		return true;
+	}
+
+	void store(const CompileContext &ctx, const SourceBuffer &p_source, const PackedStringArray &p_compiled_expressions) {
+		if (ctx.has_executed_comptime_code)
+			return;
+
+		Dictionary include_hashes;
+		for (const KeyValue<String, uint32_t> &E : ctx.included_file_hashes) {
+			include_hashes[E.key] = int64_t(E.value);
+		}
+
+		Dictionary entry;
+		entry["version"] = GDEXPR_COMPILER_VERSION;
+		entry["source_hash"] = int64_t(p_source.get_content_hash());
+		entry["settings"] = get_settings_key(ctx);
+		entry["includes"] = include_hashes;
+		entry["expressions"] = p_compiled_expressions;
+		entry["source_files"] = ctx.source_map.files;
+		entry["source_lines"] = ctx.source_map.lines;
+		entry["variable_names"] = ctx.variable_slot_names;
+
+		MutexLock lock(*mutex.ptr());
+		DirAccess::make_dir_recursive_absolute(directory);
+		Ref<FileAccess> file = FileAccess::open(get_entry_path(p_source.get_path()), FileAccess::WRITE);
+		ERR_FAIL_COND_MSG(file.is_null(), vformat("GDExpr can't write to the compile cache in %s.", directory));
+		file->store_var(entry);
+	}
+
+	// Delete every entry of the cache.
+	void clear() {
+		MutexLock lock(*mutex.ptr());
+		const PackedStringArray files = DirAccess::get_files_at(directory);
+		for (int i = 0; i < files.size(); ++i) {
+			if (files[i].get_extension() == "cache")
+				DirAccess::remove_absolute(directory.path_join(files[i]));
+		}
 	}
-
-	return result.strip_edges();
-}
+};
 
 class GDExpr : public RefCounted {
 	GDCLASS(GDExpr, RefCounted)
 
 public:
 	GDExpr() {
-		expression = memnew(Expression);
 		ERR_FAIL_COND(singleton != nullptr);
 		singleton = this;
+
+		const char *default_nondeterministic_functions[] = { "randi", "randf", "randi_range", "randf_range", "randfn", "rand_from_seed", "randomize", "seed",
+			"instance_from_id", "is_instance_id_valid", "Time", "OS" };
+		for (const char *function : default_nondeterministic_functions) {
+			nondeterministic_functions.append(function);
+		}
 	}
 
 	~GDExpr() {
-		memdelete(expression);
-		expression = nullptr;
 		ERR_FAIL_COND(singleton != this);
 		singleton = nullptr;
 	}
 
+	static GDExpr *get_singleton() { return singleton; }
+
 private:
-	inline static GDExpr *singleton = nullptr;
-	static GDExpr *get_singleton();
+	friend class GDExprDirectoryTask; // Compiles the files of a directory with compile_file.
 
-	Expression *expression = nullptr;
-	Ref<GDExprScript> base_instance = nullptr;
-	Vector<String> variables;
-	Dictionary comptime_variables;
-	HashSet<String> current_includes;
-	String file_to_compile;
-	String current_variable_name;
-	String current_variable_value;
-	Array conditional_stack;
-	bool is_inside_multiline_declaration = false;
-	bool is_inside_condition = false;
-	Array expression_inputs;
+	inline static GDExpr *singleton = nullptr;
 
-	String parse_directory(String dir_path) {
+	// NOTE: All the state of a compile lives in its CompileContext, the singleton only holds the settings and caches that are shared by every compile.
+	ExpressionCache expression_cache;
+	PreprocessorCache preprocessor_cache;
+	IncludeCache include_cache;
+	CompileCache compile_cache;
+	bool compile_cache_enabled = false;
+	ChangeTracker change_tracker;
+	bool parallel_directory_compile = false; // Directories are compiled one file per worker thread when this is enabled, see set_parallel_directory_compile.
+	bool hot_reload_enabled = false; // Programs are only tracked for changes when this is enabled, see set_hot_reload_enabled.
+	bool variables_as_inputs = false;
+	bool optimize = false;
+	bool native_literals = false;
+	PackedStringArray nondeterministic_functions; // Configs that use any of these are never baked, see bake_config.
+
+	// The inputs and instance of the last static_compile, execute_precompiled_expressions runs with them when it isn't given its own.
+	Ref<GDExprScript> static_compile_instance;
+	Array static_compile_inputs;
+
+	// Every gdexpr file in a directory, in the order they are compiled and linked.
+	PackedStringArray get_directory_files(const String &dir_path) {
+		PackedStringArray file_paths;
 		Ref<DirAccess> dir = DirAccess::open(dir_path);
+		ERR_FAIL_NULL_V_MSG(dir, file_paths, vformat("GDExpr can't open directory \"%s\".", dir_path));
+
 		PackedStringArray files = dir->get_files();
-		String expressions;
+		files.sort();
 		for (int i = 0; i < files.size(); ++i) {
-			String file = files[i];
-			if (file.get_extension() != "gdexpr")
-				continue;
-
-			String expr = parse_file(file);
-			if (expr.is_empty())
-				continue;
-
-			// Add expression and seperator to all tokens except the last one.
-			if (i != files.size() - 1) {
-				expressions += expr;
-			} else {
-				expressions += expr + "\n---";
-			}
+			if (files[i].get_extension() == "gdexpr")
+				file_paths.append(dir_path.path_join(files[i]));
 		}
 
-		return expressions;
+		return file_paths;
 	}
 
-	String parse_file(String file_path) {
+	// Files are read as raw UTF-8 and lexed from the bytes, see SourceBuffer.
+	PackedByteArray read_file_bytes(const String &file_path) {
 		Ref<FileAccess> file = FileAccess::open(file_path, FileAccess::READ);
-		ERR_FAIL_NULL_V(file, String());
+		ERR_FAIL_NULL_V(file, PackedByteArray());
 
-		return file->get_as_text(true);
+		return file->get_buffer(file->get_length());
 	}
 
-	String parse_include_file(String file_path) {
-		Ref<FileAccess> file = FileAccess::open(file_path, FileAccess::READ);
-		ERR_FAIL_NULL_V(file, String());
+	SourceBuffer parse_file(String file_path) { return SourceBuffer(read_file_bytes(file_path), file_path); }
 
-		return file->get_as_text(true);
-	}
+	SourceBuffer parse_include_file(String file_path) { return SourceBuffer(read_file_bytes(file_path), file_path); }
 
-	String check_for_comptime_vars(String var_token) {
-		Array comptime_vars_keys = comptime_variables.keys();
-		comptime_vars_keys.sort_custom(Callable(this, "sort_by_longest")); // TODO OPTIMIZE - is it possible/faster to sort at insertion time???
+	String check_for_comptime_vars(CompileContext &ctx, const String &var_token) { return substitute_identifiers(var_token, ctx.comptime_variable_text); }
 
-		for (int i = 0; i < comptime_vars_keys.size(); ++i) {
-			String variable = comptime_vars_keys[i];
-			if (var_token.contains(variable)) {
-				var_token = var_token.replace(variable, comptime_variables[variable]);
-			}
-		}
+	// Replace variables with their slot reads and comptime variables with their values. Variables win when a name is both.
+	String check_for_variables(CompileContext &ctx, const String &token) { return substitute_identifiers(token, ctx.variable_reads, &ctx.comptime_variable_text); }
 
-		return var_token;
+	void set_comptime_variable(CompileContext &ctx, const String &variable_name, const Variant &value) {
+		ctx.comptime_variables[variable_name] = value;
+		ctx.comptime_variable_text.insert(variable_name, value);
 	}
 
-	String get_comptime_var_value(PackedStringArray &line_tokens) {
+	String get_comptime_var_value(CompileContext &ctx, PackedStringArray &line_tokens) {
 		String variable_name = line_tokens[2];
 		String variable_value;
 		for (int j = 4; j < line_tokens.size(); ++j) {
 			variable_value += line_tokens[j] + " ";
 		}
 
-		variable_value = check_for_comptime_vars(variable_value);
+		variable_value = check_for_comptime_vars(ctx, variable_value);
 		return variable_value;
 	}
 
-	void preprocess_variables(PackedStringArray &line_tokens, PackedStringArray &expression_tokens) {
+	// Every variable gets a slot index the first time it is declared, redeclaring a variable reuses its slot.
+	void declare_variable(CompileContext &ctx, const String &variable_name) {
+		if (ctx.variable_slots.has(variable_name))
+			return;
+
+		const int slot = ctx.variable_slot_names.size();
+		ctx.variable_slots.insert(variable_name, slot);
+		ctx.variable_slot_names.append(variable_name);
+		if (ctx.named_variables)
+			ctx.variable_reads.insert(variable_name, vformat("get_var(\"%s\")", variable_name));
+		else if (!ctx.variables_as_inputs)
+			ctx.variable_reads.insert(variable_name, vformat("get_slot(%d)", slot));
+	}
+
+	// The call that writes p_value into the variable in p_slot.
+	String get_variable_write(const CompileContext &ctx, int p_slot, const String &p_value) {
+		if (ctx.named_variables)
+			return vformat("set_var(\"%s\", %s)", ctx.variable_slot_names[p_slot], p_value);
+
+		return vformat("set_slot(%d, %s)", p_slot, p_value);
+	}
+
+	void preprocess_variables(CompileContext &ctx, PackedStringArray &line_tokens, PackedStringArray &expression_tokens) {
 		String variable_name = line_tokens[1];
 		String variable_value;
 
 		if (line_tokens[line_tokens.size() - 1].ends_with("(")) {
-			is_inside_multiline_declaration = true;
+			ctx.is_inside_multiline_declaration = true;
 		}
 
 		for (int j = 3; j < line_tokens.size(); ++j) {
 			variable_value += line_tokens[j] + " ";
 		}
 
-		for (String variable : variables) {
-			if (variable_value.contains(variable)) {
-				variable_value = variable_value.replace(variable, vformat("get_var(\"%s\")", variable));
-			}
-		}
+		// When variables are expression inputs they are read by name so only writes have to be rewritten.
+		variable_value = check_for_variables(ctx, variable_value);
 
-		variables.append(variable_name);
-		variables.sort_custom<SortByLongest>(); // TODO OPTIMIZE - is it possible/faster to sort at insertion time???
-
-		if (!is_inside_multiline_declaration) {
-			String var_token = vformat("set_var(\"%s\", %s)+", variable_name, variable_value);
-			var_token = check_for_comptime_vars(var_token);
+		declare_variable(ctx, variable_name);
 
+		if (!ctx.is_inside_multiline_declaration) {
+			String var_token = get_variable_write(ctx, ctx.variable_slots[variable_name], variable_value) + "+";
 			expression_tokens.append(var_token);
 			line_tokens.append("---");
 		} else {
-			current_variable_name = variable_name;
-			current_variable_value = variable_value;
+			ctx.current_variable_slot = ctx.variable_slots[variable_name];
+			ctx.current_variable_value = variable_value;
 		}
 	}
 
-	void reset_to_default_state() {
-		file_to_compile = "";
-		current_variable_name = "";
-		current_variable_value = "";
-		is_inside_multiline_declaration = false;
-		is_inside_condition = false;
-
-		conditional_stack.clear();
-		comptime_variables.clear();
-		variables.clear();
-		current_includes.clear();
-		expression_inputs.clear();
-	}
-
-	Variant comptime_execute(String expression_to_parse) {
+	Variant comptime_execute(CompileContext &ctx, String expression_to_parse) {
 		// Execute an expression at comptime
-
+		ctx.has_executed_comptime_code = true;
+		Ref<Expression> &expression = ctx.comptime_expression;
 		expression->parse(expression_to_parse);
-		Variant result = expression->execute(expression_inputs, *base_instance);
+		Variant result = expression->execute(ctx.expression_inputs, *ctx.base_instance);
 
 		if (expression->has_execute_failed()) {
-			UtilityFunctions::printerr(vformat("[%s] - ", file_to_compile), "GDExpr comptime expression: \"", expression_to_parse,
+			UtilityFunctions::printerr(vformat("[%s] - ", ctx.file_to_compile), "GDExpr comptime expression: \"", expression_to_parse,
 					"\" failed to execute with error: ", expression->get_error_text());
 		}
 
@@ -396,133 +2423,263 @@ private:
 		return result;
 	}
 
-	Array _execute_expressions(PackedStringArray compiled_expression, String file_to_compile, bool is_running_as_interpreter) {
+	// Parse a sequence of compiled expressions into a program that can be executed without any more compiling or parsing.
+	Ref<GDExprProgram> create_program_from_expressions(
+			const CompileContext &ctx, const PackedStringArray &p_compiled_expressions, const PackedStringArray &p_input_names, const String &p_source_path) {
+		Ref<GDExprProgram> program;
+		program.instantiate();
+		fill_program(ctx, program, p_compiled_expressions, p_input_names, p_source_path);
+		return program;
+	}
+
+	// Parse compiled expressions through the expression cache and put them into p_program, replacing anything it had before.
+	void fill_program(const CompileContext &ctx, const Ref<GDExprProgram> &p_program, const PackedStringArray &p_compiled_expressions, const PackedStringArray &p_input_names,
+			const String &p_source_path) {
+		CompiledProgramData program_data;
+		program_data.expressions = p_compiled_expressions;
+		program_data.input_names = p_input_names;
+		program_data.variable_names = ctx.variable_slot_names;
+		program_data.source_path = p_source_path;
+		program_data.variables_as_inputs = ctx.variables_as_inputs;
+		program_data.source_map = ctx.source_map;
+		fill_program(p_program, program_data);
+	}
+
 #ifdef GDEXPR_COMPILER_TIMING_DEBUG
-		TIME_START(gdexpr_execution)
+	// Compare the LiteralParser against parsing and executing the same literals with Expression, whether or not native_literals is on. Run it on
+	// project/demo/test_large_config.gdexpr to see if native_literals is worth turning on.
+	void time_native_literals(const PackedStringArray &p_expressions, const PackedStringArray &p_input_names) {
+		LiteralParser literal_parser;
+		PackedStringArray literals;
+		TIME_START(native_literals)
+		for (int i = 0; i < p_expressions.size(); ++i) {
+			Variant constant_value;
+			if (literal_parser.parse(p_expressions[i], p_input_names, constant_value))
+				literals.append(p_expressions[i]);
+		}
+		TIME_MICRO_END(native_literals)
+
+		TIME_START(expression_literals)
+		for (int i = 0; i < literals.size(); ++i) {
+			Ref<Expression> expression;
+			expression.instantiate();
+			expression->parse(literals[i], p_input_names);
+			expression->execute(Array(), nullptr, false, true);
+		}
+		TIME_MICRO_END(expression_literals)
+
+		UtilityFunctions::print(literals.size(), " of ", p_expressions.size(), " expressions are literals");
+	}
 #endif
 
-		Array results;
-		for (int i = 0; i < compiled_expression.size(); ++i) {
-			String expression_to_parse = compiled_expression[i];
+	void fill_program(const Ref<GDExprProgram> &p_program, const CompiledProgramData &p_program_data) {
+		PackedStringArray parse_input_names = p_program_data.input_names;
+		if (p_program_data.variables_as_inputs)
+			parse_input_names.append_array(p_program_data.variable_names);
 
-			expression->parse(expression_to_parse);
-			Variant result = expression->execute(expression_inputs, *base_instance);
+#ifdef GDEXPR_COMPILER_TIMING_DEBUG
+		time_native_literals(p_program_data.expressions, parse_input_names);
+#endif
 
-			if (expression->has_execute_failed()) {
-				if (is_running_as_interpreter) {
-					UtilityFunctions::printerr(
-							vformat("[%d] - ", i + 1), "GDExpr expression: \"", expression_to_parse, "\" failed to execute with error: ", expression->get_error_text());
-				} else {
-					UtilityFunctions::printerr(vformat("[%s:%d] - ", file_to_compile, i + 1), "GDExpr expression: \"", expression_to_parse,
-							"\" failed to execute with error: ", expression->get_error_text());
-				}
+		LiteralParser literal_parser;
+		HashMap<String, Ref<Expression>> program_expressions; // Expressions that repeat in the program share one Expression, only one execution uses it at a time.
+		Vector<Ref<Expression>> parsed_expressions;
+		Vector<Variant> constant_values;
+		parsed_expressions.resize(p_program_data.expressions.size());
+		constant_values.resize(p_program_data.expressions.size());
+		for (int i = 0; i < p_program_data.expressions.size(); ++i) {
+			// Literals are turned into their value right away, they never go through the expression cache or the Expression engine.
+			Variant constant_value;
+			if (native_literals and literal_parser.parse(p_program_data.expressions[i], parse_input_names, constant_value)) {
+				constant_values.write[i] = constant_value;
 				continue;
 			}
 
-#ifdef GDEXPR_COMPILER_DEBUG
-			UtilityFunctions::print("EXPR TO PARSE: ", expression_to_parse);
-			UtilityFunctions::print("EXPR RESULT: ", result);
-#endif
+			const Ref<Expression> *expression = program_expressions.getptr(p_program_data.expressions[i]);
+			if (expression == nullptr)
+				expression = &program_expressions.insert(p_program_data.expressions[i], expression_cache.get_expression(p_program_data.expressions[i], parse_input_names))->value;
 
-			results.push_back(result);
+			parsed_expressions.write[i] = *expression;
 		}
 
-		reset_to_default_state();
+		// Expressions that didn't come from a file, like the ones of create_program, don't have a source map at all.
+		SourceMap source_map = p_program_data.source_map;
+		if (source_map.size() != p_program_data.expressions.size())
+			source_map.clear();
 
-#ifdef GDEXPR_COMPILER_TIMING_DEBUG
-		TIME_MICRO_END(gdexpr_execution)
-#endif
-		return results;
+		p_program->set_compiled_expressions(p_program_data.expressions, parsed_expressions, p_program_data.input_names, p_program_data.variable_names,
+				p_program_data.variables_as_inputs, p_program_data.source_path, source_map, constant_values);
 	}
 
-	PackedStringArray compile(String input_string) {
-		PackedStringArray compiled_expressions;
-		PackedStringArray expression_tokens;
-		Dictionary macro_defines;
-		Array macro_define_keys;
-		PackedStringArray lines = input_string.split("\n");
-		bool is_config_script = lines.size() > 0 and lines[0] == "@config" ? true : false;
+	Array _execute_expressions(const CompileContext &ctx, PackedStringArray compiled_expression, bool is_running_as_interpreter) {
+		Ref<GDExprProgram> program = create_program_from_expressions(ctx, compiled_expression, PackedStringArray(), is_running_as_interpreter ? String() : ctx.file_to_compile);
+		return program->execute(ctx.expression_inputs, ctx.base_instance);
+	}
 
-		// Stripped down version of the compiler that only has a break statement.
-		// This is ideal for use with scripts that don't use any variables or conditional logic and will be significantly faster to compile than the full language.
-		if (is_config_script) {
-			String expr_string = "";
-			for (int i = 1; i < lines.size(); ++i) {
-				String line = lines[i];
+	// Key of a compiled include. An include compiles to the same output as long as its content, the variable slots, the comptime variables and the way variables
+	// are compiled are the same. Macros don't matter since they never leak into an include.
+	String get_include_key(const CompileContext &ctx, const String &include_path, uint32_t content_hash) {
+		uint32_t environment_hash = hash_murmur3_one_32(uint32_t(ctx.variables_as_inputs) | (uint32_t(ctx.named_variables) << 1));
+		for (int i = 0; i < ctx.variable_slot_names.size(); ++i) {
+			environment_hash = hash_murmur3_one_32(uint32_t(ctx.variable_slot_names[i].hash()), environment_hash);
+		}
 
-				if (line.is_empty())
-					continue;
+		for (const KeyValue<String, String> &E : ctx.comptime_variable_text) {
+			environment_hash = hash_murmur3_one_32(uint32_t(E.key.hash()), environment_hash);
+			environment_hash = hash_murmur3_one_32(uint32_t(E.value.hash()), environment_hash);
+		}
 
-				// Split by white space
-				String line_tokens = whitespace_split_string(line, " ");
-				if (line_tokens.is_empty())
-					continue;
+		return vformat("%s|%x|%x", include_path, content_hash, environment_hash);
+	}
 
-				// Break expression
-				if (line_tokens.begins_with("break") or line_tokens.begins_with("---")) {
-					if (!expr_string.is_empty()) {
-						compiled_expressions.append(expr_string);
-						expr_string = "";
-						continue;
-					}
-				}
+	// Apply everything compiling an include changed in the context, the same as if it was compiled again.
+	void replay_include(CompileContext &ctx, const CompiledInclude &include) {
+		for (int i = 0; i < include.declared_variables.size(); ++i) {
+			declare_variable(ctx, include.declared_variables[i]);
+		}
 
-				// expression_tokens.append(String().join(line_tokens));
-				expr_string += line_tokens;
-			}
+		const Array comptime_variable_names = include.comptime_variables.keys();
+		for (int i = 0; i < comptime_variable_names.size(); ++i) {
+			set_comptime_variable(ctx, comptime_variable_names[i], include.comptime_variables[comptime_variable_names[i]]);
+		}
 
-			if (!expr_string.is_empty())
-				compiled_expressions.append(expr_string);
+		for (const KeyValue<String, uint32_t> &E : include.included_file_hashes) {
+			ctx.included_file_hashes.insert(E.key, E.value);
+		}
 
-			return compiled_expressions;
+		ctx.has_executed_comptime_code = ctx.has_executed_comptime_code or include.has_executed_comptime_code;
+		ctx.source_map.append(include.source_map);
+	}
+
+	// Returns false if a file the include included changed since it was compiled. The include itself is already part of its key.
+	bool is_include_up_to_date(const CompiledInclude &include, const String &include_path) {
+		for (const KeyValue<String, uint32_t> &E : include.included_file_hashes) {
+			if (E.key != include_path and SourceBuffer(FileAccess::get_file_as_bytes(E.key)).get_content_hash() != E.value)
+				return false;
 		}
 
-		// Full compiler with all gdexpr features
-		for (int i = 0; i < lines.size(); ++i) {
-			String line = lines[i];
+		return true;
+	}
 
-			if (line.is_empty())
-				continue;
+	// Compile an include, or replay it if it was already compiled in the same environment, earlier in this compile or by another compile.
+	PackedStringArray compile_include(CompileContext &ctx, const String &include_path) {
+		SourceBuffer include_source = parse_include_file(include_path);
+		const uint32_t content_hash = include_source.get_content_hash();
+		const String include_key = get_include_key(ctx, include_path, content_hash);
 
-			// Split by white space
-			line = line.strip_edges();
-			PackedStringArray line_tokens = whitespace_split(line, " ");
-			if (line_tokens.is_empty())
-				continue;
+		const CompiledInclude *compiled_include = ctx.compiled_includes.getptr(include_key);
+		CompiledInclude shared_include;
+		if (compiled_include == nullptr and include_cache.get(include_key, shared_include) and is_include_up_to_date(shared_include, include_path))
+			compiled_include = &shared_include;
 
-			// Simple 1 line C style object-like macros
-			if (line_tokens[0] == String("define")) {
-				String define_name = line_tokens[1];
-				String define_value;
-				for (int j = 2; j < line_tokens.size(); ++j) {
-					define_value += line_tokens[j];
-				}
+		if (compiled_include != nullptr) {
+			replay_include(ctx, *compiled_include);
+			return compiled_include->expressions;
+		}
 
-				macro_defines[define_name] = define_value;
-				macro_define_keys = macro_defines.keys();
+		// Compile the include on its own and record everything it changes in the context.
+		HashMap<String, uint32_t> outer_included_file_hashes = ctx.included_file_hashes;
+		ctx.included_file_hashes.clear();
+		const bool outer_has_executed_comptime_code = ctx.has_executed_comptime_code;
+		ctx.has_executed_comptime_code = false;
+		const int slot_count = ctx.variable_slot_names.size();
+		const Dictionary outer_comptime_variables = ctx.comptime_variables.duplicate();
+		const int conditional_stack_size = ctx.conditional_stack.size();
+		const bool was_inside_condition = ctx.is_inside_condition;
+		const bool was_inside_multiline_declaration = ctx.is_inside_multiline_declaration;
+
+		const int source_map_start = ctx.source_map.size();
+		CompiledInclude include;
+		include.expressions = compile(ctx, include_source);
+		include.source_map = ctx.source_map.slice(source_map_start);
+		ctx.included_file_hashes.insert(include_path, content_hash);
+		include.included_file_hashes = ctx.included_file_hashes;
+		include.declared_variables = ctx.variable_slot_names.slice(slot_count);
+		include.has_executed_comptime_code = ctx.has_executed_comptime_code;
+
+		const Array comptime_variable_names = ctx.comptime_variables.keys();
+		for (int i = 0; i < comptime_variable_names.size(); ++i) {
+			const Variant &name = comptime_variable_names[i];
+			if (!outer_comptime_variables.has(name) or outer_comptime_variables[name] != ctx.comptime_variables[name])
+				include.comptime_variables[name] = ctx.comptime_variables[name];
+		}
 
-				continue;
+		for (const KeyValue<String, uint32_t> &E : outer_included_file_hashes) {
+			ctx.included_file_hashes.insert(E.key, E.value);
+		}
+		ctx.has_executed_comptime_code = ctx.has_executed_comptime_code or outer_has_executed_comptime_code;
+
+		// An include that leaves a condition or a multi-line declaration open depends on what comes after it, so it is never reused.
+		if (ctx.conditional_stack.size() == conditional_stack_size and ctx.is_inside_condition == was_inside_condition and
+				ctx.is_inside_multiline_declaration == was_inside_multiline_declaration) {
+			ctx.compiled_includes.insert(include_key, include);
+			if (!include.has_executed_comptime_code)
+				include_cache.set(include_key, include);
+		}
+
+		return include.expressions;
+	}
+
+	// Compile a source and add the file and line of every expression it compiles to to the source map of ctx, includes are compiled the same way.
+	PackedStringArray compile(CompileContext &ctx, const SourceBuffer &source) {
+		const int source_map_start = ctx.source_map.size();
+		PackedStringArray compiled_expressions = compile_lines(ctx, source);
+
+		// Expressions that were thrown away by bail or an error still have their entries, only keep the ones of the expressions that were returned.
+		ctx.source_map.resize(source_map_start + compiled_expressions.size());
+		return compiled_expressions;
+	}
+
+	PackedStringArray compile_lines(CompileContext &ctx, const SourceBuffer &source) {
+		PackedStringArray compiled_expressions;
+		PackedStringArray expression_tokens;
+		LocalVector<SourceToken> source_tokens;
+		source.tokenize(source_tokens);
+		bool is_config_script = source_tokens.size() > 0 and source_tokens[0].line == 0 and get_line_end(source_tokens, 0) == 1 and
+				source.get_token_text(source_tokens[0]) == "@config";
+
+		// Stripped down version of the compiler that only has a break statement.
+		// This is ideal for use with scripts that don't use any variables or conditional logic and will be significantly faster to compile than the full language.
+		if (is_config_script) {
+			PackedInt32Array expression_lines;
+			if (source.has_utf8()) {
+				compile_config_script(source.get_utf8(), source_tokens, compiled_expressions, expression_lines);
+			} else {
+				compile_config_script(source.get_text().ptr(), source_tokens, compiled_expressions, expression_lines);
 			}
 
-			// Replace defines with their value, this has to be done before any other tokens are processed so the text will be correct.
-			if (macro_define_keys.size() > 0) {
-				for (int j = 0; j < line_tokens.size(); ++j) {
-					for (int k = 0; k < macro_define_keys.size(); ++k) {
-						if (line_tokens[j].contains(macro_define_keys[k]) and !line_tokens[j].contains(macro_defines[macro_define_keys[k]])) {
-							line_tokens[j] = line_tokens[j].replace(macro_define_keys[k], macro_defines[macro_define_keys[k]]);
-						}
-					}
-				}
+			for (int i = 0; i < expression_lines.size(); ++i) {
+				ctx.source_map.add(source.get_path(), expression_lines[i]);
 			}
 
+			return compiled_expressions;
+		}
+
+		// Full compiler with all gdexpr features
+		Vector<PackedStringArray> lines;
+		PackedInt32Array line_numbers;
+		const uint32_t content_hash = source.get_content_hash();
+		if (source.get_path().is_empty() or !preprocessor_cache.get_lines(source.get_path(), content_hash, lines, line_numbers)) {
+			MacroPreprocessor preprocessor;
+			lines = preprocessor.preprocess(source, source_tokens, line_numbers);
+			if (!source.get_path().is_empty())
+				preprocessor_cache.set_lines(source.get_path(), content_hash, lines, line_numbers);
+		}
+
+		int expression_line = 0; // Source line of the first line of the expression being compiled.
+		for (int line_index = 0; line_index < lines.size(); ++line_index) {
+			PackedStringArray line_tokens = lines[line_index];
+			if (expression_tokens.is_empty())
+				expression_line = line_numbers[line_index];
+
 			// Replace 'comptime var X = Y' with 'set_var("X", "Y")', evaluate the result, and save it in the comptime variables map.
 			if (line_tokens[0] == String("comptime") and line_tokens.size() >= 5) {
-				comptime_variables[line_tokens[2]] = comptime_execute(get_comptime_var_value(line_tokens));
+				set_comptime_variable(ctx, line_tokens[2], comptime_execute(ctx, get_comptime_var_value(ctx, line_tokens)));
 				continue;
 			}
 
-			if (is_inside_condition and !conditional_stack.front()) {
-				if (line_tokens[0] != "end" and conditional_stack.size() > 0)
+			if (ctx.is_inside_condition and !ctx.conditional_stack.front()) {
+				if (line_tokens[0] != "end" and ctx.conditional_stack.size() > 0)
 					continue;
 			}
 
@@ -533,6 +2690,7 @@ private:
 				String expr = String().join(expression_tokens);
 				if (!expr.is_empty()) {
 					compiled_expressions.append(expr.trim_suffix("+"));
+					ctx.source_map.add(source.get_path(), expression_line);
 					expression_tokens.clear();
 				}
 
@@ -544,18 +2702,19 @@ private:
 					}
 				}
 
-				is_inside_condition = true;
-				conditional_stack.push_front(comptime_execute(check_for_comptime_vars(if_condition)));
+				ctx.is_inside_condition = true;
+				ctx.conditional_stack.push_front(comptime_execute(ctx, check_for_comptime_vars(ctx, if_condition)));
 				continue;
 			}
 
 			if (line_tokens[0] == String("end")) {
-				is_inside_condition = false;
-				conditional_stack.pop_front();
+				ctx.is_inside_condition = false;
+				ctx.conditional_stack.pop_front();
 
 				String expr = String().join(expression_tokens);
 				if (!expr.is_empty()) {
 					compiled_expressions.append(expr.trim_suffix("+"));
+					ctx.source_map.add(source.get_path(), expression_line);
 					expression_tokens.clear();
 				}
 
@@ -570,18 +2729,17 @@ private:
 				}
 
 				// Check if the file is already being included to prevent infinite recursion due to circular imports.
-				ERR_FAIL_COND_V_MSG(current_includes.find(file_name) != current_includes.end(), PackedStringArray(),
+				ERR_FAIL_COND_V_MSG(ctx.current_includes.find(file_name) != ctx.current_includes.end(), PackedStringArray(),
 						vformat("GDExpr circular include detected in %s...aborting include.", file_name));
 
-				current_includes.insert(file_name);
-				String file_content = parse_include_file(file_name);
-				PackedStringArray include_file_tokens = compile(file_content);
+				ctx.current_includes.insert(file_name);
+				PackedStringArray include_file_tokens = compile_include(ctx, file_name);
 
 				for (int i = 0; i < include_file_tokens.size(); ++i) {
 					compiled_expressions.append(include_file_tokens[i]);
 				}
 
-				current_includes.erase(file_name);
+				ctx.current_includes.erase(file_name);
 				continue;
 			}
 
@@ -595,9 +2753,9 @@ private:
 				return PackedStringArray();
 			}
 
-			// Replace 'var X = Y' with 'set_var("X", "Y")'
+			// Replace 'var X = Y' with 'set_slot(N, Y)' where N is the slot index of X
 			if (line_tokens[0] == String("var")) {
-				preprocess_variables(line_tokens, expression_tokens);
+				preprocess_variables(ctx, line_tokens, expression_tokens);
 				continue;
 			}
 
@@ -623,8 +2781,8 @@ private:
 					if (iterations_token.is_valid_int()) {
 						repeat_num = iterations_token.to_int();
 					} else {
-						if (comptime_variables.has(iterations_token)) {
-							Variant variable_value = comptime_variables[iterations_token];
+						if (ctx.comptime_variables.has(iterations_token)) {
+							Variant variable_value = ctx.comptime_variables[iterations_token];
 							if (variable_value.get_type() == Variant::INT) {
 								repeat_num = variable_value;
 							}
@@ -639,14 +2797,17 @@ private:
 						while (repeat_num >= 0) {
 							if (!is_adding_expressions) {
 								compiled_expressions.append(expr.trim_suffix("+"));
+								ctx.source_map.add(source.get_path(), expression_line);
 							} else {
 								expression_tokens.append_array(original_expression_tokens);
 							}
 							repeat_num--;
 						}
 
-						if (is_adding_expressions)
+						if (is_adding_expressions) {
 							compiled_expressions.append(String().join(expression_tokens).trim_suffix("+"));
+							ctx.source_map.add(source.get_path(), expression_line);
+						}
 					}
 
 					expression_tokens.clear();
@@ -659,57 +2820,53 @@ private:
 				String expr = String().join(expression_tokens);
 				if (!expr.is_empty()) {
 					compiled_expressions.append(expr.trim_suffix("+"));
+					ctx.source_map.add(source.get_path(), expression_line);
 					expression_tokens.clear();
 					continue;
 				}
 			}
 
 			// End of multi-line declarations
-			if (line_tokens[0] == ")" and is_inside_multiline_declaration) {
-				String var_token = vformat("set_var(\"%s\", %s)", current_variable_name, current_variable_value) + ")+";
-				var_token = check_for_comptime_vars(var_token);
+			if (line_tokens[0] == ")" and ctx.is_inside_multiline_declaration) {
+				String var_token = get_variable_write(ctx, ctx.current_variable_slot, ctx.current_variable_value) + ")+";
 
-				is_inside_multiline_declaration = false;
+				ctx.is_inside_multiline_declaration = false;
 				expression_tokens.append(var_token);
 				String expr = String().join(expression_tokens);
 				if (!expr.is_empty()) {
 					compiled_expressions.append(expr.trim_suffix("+"));
+					ctx.source_map.add(source.get_path(), expression_line);
 					expression_tokens.clear();
 					continue;
 				}
 			}
 
-			// No need to iterate over tokens if there are no variables.
-			if (variables.size() < 1) {
+			// No need to iterate over tokens if there is nothing to replace, variables that are expression inputs are read by their name.
+			if (ctx.variable_reads.is_empty() and ctx.comptime_variable_text.is_empty() and !ctx.is_inside_multiline_declaration) {
 				expression_tokens.append(String().join(line_tokens));
 				continue;
 			}
 
 			for (int j = 0; j < line_tokens.size(); ++j) {
-				// Replace token "X" with a variable name declared using "var"
-				for (String variable : variables) {
-					String current_variable = line_tokens[j];
-					if (current_variable.contains(variable) and !current_variable.contains("get_var(\"")) {
-						line_tokens[j] = current_variable.replace(variable, vformat("get_var(\"%s\")", variable));
-					}
-				}
-
-				line_tokens[j] = check_for_comptime_vars(line_tokens[j]);
+				// Replace variables declared using "var" with their slot and comptime variables with their value, only whole identifiers are replaced.
+				line_tokens.set(j, check_for_variables(ctx, line_tokens[j]));
 
 				// Add processed tokens
-				if (line_tokens[j] != "" and !is_inside_multiline_declaration)
+				if (line_tokens[j] != "" and !ctx.is_inside_multiline_declaration)
 					expression_tokens.append(line_tokens[j]);
 			}
 
 			// If inside multi-line declaration, add text to the variable value.
-			if (is_inside_multiline_declaration) {
-				current_variable_value += String().join(line_tokens);
+			if (ctx.is_inside_multiline_declaration) {
+				ctx.current_variable_value += String().join(line_tokens);
 				continue;
 			}
 		}
 
-		if (!expression_tokens.is_empty())
+		if (!expression_tokens.is_empty()) {
 			compiled_expressions.append(String().join(expression_tokens).trim_suffix("+"));
+			ctx.source_map.add(source.get_path(), expression_line);
+		}
 		return compiled_expressions;
 	}
 
@@ -722,105 +2879,678 @@ private:
 	// that the compiler doesn't handle.
 	//void sanitize() {}
 
-	PackedStringArray compile_directory(String dir_path) { return compile(parse_directory(dir_path)); }
+	// Compile a whole gdexpr source and optimize the result. compile itself also runs on every include so the optimizations can only run once it is done.
+	PackedStringArray compile_source(CompileContext &ctx, const SourceBuffer &source) {
+		PackedStringArray compiled_expressions = compile(ctx, source);
+		if (!ctx.optimize)
+			return compiled_expressions;
+
+		ExpressionOptimizer optimizer;
+		return optimizer.optimize(compiled_expressions, ctx.variable_slot_names, ctx.variables_as_inputs);
+	}
+
+	// Compile every file of a directory, see parallel_directory_compile.
+	PackedStringArray compile_directory(CompileContext &ctx, String dir_path) {
+		const PackedStringArray file_paths = get_directory_files(dir_path);
+		if (!parallel_directory_compile)
+			return compile_directory_source(ctx, file_paths);
+
+		// Every file gets its own compile context, so files only see the variables, comptime variables and macros they declare or include themselves.
+		Ref<GDExprDirectoryTask> task;
+		task.instantiate();
+		task->setup(Ref<GDExpr>(this), ctx.expression_inputs, ctx.base_instance, ctx.variables_as_inputs, ctx.optimize, file_paths);
+		run_directory_task(task, "GDExpr directory compile");
+		return link_directory(ctx, task);
+	}
+
+	// Compile the files of a directory as one source on the calling thread, every file sees the variables, comptime variables and macros of the files before it.
+	// Expressions are mapped back to the file and line they came from.
+	PackedStringArray compile_directory_source(CompileContext &ctx, const PackedStringArray &file_paths) {
+		const PackedByteArray separator = String("\n---\n").to_utf8_buffer();
+		PackedByteArray directory_source;
+		PackedInt32Array file_start_lines; // The number of lines in the directory source before every file.
+		int line_count = 0;
+		for (int i = 0; i < file_paths.size(); ++i) {
+			const PackedByteArray file_bytes = read_file_bytes(file_paths[i]);
+			file_start_lines.append(line_count);
+			directory_source.append_array(file_bytes);
+			directory_source.append_array(separator);
+
+			// The separator ends the last line of the file and adds the --- line.
+			line_count += 2;
+			const uint8_t *bytes = file_bytes.ptr();
+			for (int64_t j = 0; j < file_bytes.size(); ++j) {
+				if (bytes[j] == '\n')
+					line_count++;
+			}
+		}
+
+		const int source_map_start = ctx.source_map.size();
+		PackedStringArray compiled_expressions = compile_source(ctx, SourceBuffer(directory_source));
+
+		// Expressions of includes already have their own file, only the ones of the directory source have none.
+		for (int i = source_map_start; i < ctx.source_map.size(); ++i) {
+			if (!ctx.source_map.files[i].is_empty())
+				continue;
+
+			const int line = ctx.source_map.lines[i];
+			int file = file_start_lines.size() - 1;
+			while (file > 0 and line <= file_start_lines[file]) {
+				file--;
+			}
+
+			if (file < 0)
+				continue;
+
+			ctx.source_map.files.set(i, file_paths[file]);
+			ctx.source_map.lines.set(i, line - file_start_lines[file]);
+		}
+
+		return compiled_expressions;
+	}
+
+	// Compile every file of a directory task, in parallel on the WorkerThreadPool if parallel_directory_compile is enabled and one after another otherwise.
+	void run_directory_task(const Ref<GDExprDirectoryTask> &task, const String &description) {
+		if (!parallel_directory_compile) {
+			for (int i = 0; i < task->get_file_count(); ++i) {
+				task->compile_file(i);
+			}
+			return;
+		}
+
+		WorkerThreadPool *thread_pool = WorkerThreadPool::get_singleton();
+		int64_t group_id = thread_pool->add_group_task(callable_mp(task.ptr(), &GDExprDirectoryTask::compile_file), task->get_file_count(), -1, true, description);
+		thread_pool->wait_for_group_task_completion(group_id);
+	}
+
+	// Append the expressions of every file to one sequence. Every file numbers its variable slots from 0, so they are moved to the slots of ctx, files that declare
+	// a variable with the same name share its slot like they did when the directory was compiled as one file.
+	PackedStringArray link_directory(CompileContext &ctx, const Ref<GDExprDirectoryTask> &task) {
+		PackedStringArray linked_expressions;
+		LocalVector<int> slot_map;
+		for (int file = 0; file < task->get_file_count(); ++file) {
+			const PackedStringArray &variable_names = task->get_file_variable_names(file);
+			slot_map.resize(variable_names.size());
+			for (int slot = 0; slot < variable_names.size(); ++slot) {
+				declare_variable(ctx, variable_names[slot]);
+				slot_map[slot] = ctx.variable_slots[variable_names[slot]];
+			}
+
+			const PackedStringArray &expressions = task->get_file_expressions(file);
+			for (int i = 0; i < expressions.size(); ++i) {
+				linked_expressions.append(remap_slots(expressions[i], slot_map));
+			}
+
+			ctx.source_map.append(task->get_file_source_map(file));
+		}
+
+		return linked_expressions;
+	}
+
+	PackedStringArray compile_file(CompileContext &ctx, String file_path) {
+		SourceBuffer source = parse_file(file_path);
+		ctx.source_hash = source.get_content_hash();
+		PackedStringArray arr;
+		if (!compile_cache_enabled or !compile_cache.load(ctx, source, arr)) {
+			arr = compile_source(ctx, source);
+			if (compile_cache_enabled)
+				compile_cache.store(ctx, source, arr);
+		}
 
-	PackedStringArray compile_file(String file_path) {
 #ifdef GDEXPR_COMPILER_DEBUG
-		PackedStringArray arr = compile(parse_file(file_path));
 		UtilityFunctions::print("GDExpr compiled expressions: ", arr);
-		return arr;
-#else
-		return compile(parse_file(file_path));
 #endif
+		return arr;
 	}
 
 protected:
 	static void _bind_methods() {
 		ClassDB::bind_method(D_METHOD("static_compile", "user_expression_inputs", "base_expression_instance", "user_file_to_compile"), &GDExpr::static_compile);
-		ClassDB::bind_method(D_METHOD("execute_precompiled_expressions", "compiled_expression", "string_to_execute"), &GDExpr::execute_precompiled_expressions);
+		ClassDB::bind_method(D_METHOD("compile_program", "user_expression_inputs", "base_expression_instance", "user_file_to_compile", "input_names"), &GDExpr::compile_program,
+				DEFVAL(PackedStringArray()));
+		ClassDB::bind_method(D_METHOD("compile_program_async", "user_expression_inputs", "base_expression_instance", "user_file_to_compile", "input_names"),
+				&GDExpr::compile_program_async, DEFVAL(PackedStringArray()));
+		ClassDB::bind_method(D_METHOD("create_program", "compiled_expressions", "input_names"), &GDExpr::create_program, DEFVAL(PackedStringArray()));
+		ClassDB::bind_method(D_METHOD("create_execution", "program", "inputs", "instance"), &GDExpr::create_execution);
+		ClassDB::bind_method(D_METHOD("save_program", "program", "path"), &GDExpr::save_program);
+		ClassDB::bind_method(D_METHOD("load_program", "path"), &GDExpr::load_program);
+		ClassDB::bind_method(D_METHOD("build_bundle", "dir_path", "bundle_path", "compression_mode", "user_expression_inputs", "base_expression_instance"),
+				&GDExpr::build_bundle, DEFVAL(-1), DEFVAL(Array()), DEFVAL(Variant()));
+		ClassDB::bind_method(D_METHOD("open_bundle", "path"), &GDExpr::open_bundle);
+		ClassDB::bind_method(D_METHOD("bake_config", "config_path"), &GDExpr::bake_config);
+		ClassDB::bind_method(D_METHOD("load_baked_config", "config_path"), &GDExpr::load_baked_config);
+		ClassDB::bind_method(D_METHOD("execute_precompiled_expressions", "compiled_expression", "string_to_execute", "user_expression_inputs", "base_expression_instance"),
+				&GDExpr::execute_precompiled_expressions, DEFVAL(Array()), DEFVAL(Variant()));
 		ClassDB::bind_method(D_METHOD("execute", "user_expression_inputs", "base_expression_instance", "string_to_execute"), &GDExpr::execute);
+		ClassDB::bind_method(D_METHOD("execute_batch", "program", "contexts", "inputs_per_context"), &GDExpr::execute_batch, DEFVAL(Array()));
+		ClassDB::bind_method(D_METHOD("execute_batch_parallel", "program", "contexts", "inputs_per_context", "grain_size"), &GDExpr::execute_batch_parallel, DEFVAL(Array()),
+				DEFVAL(0));
 		ClassDB::bind_method(D_METHOD("execute_file", "user_expression_inputs", "base_expression_instance", "user_file_to_compile"), &GDExpr::execute_file);
 		ClassDB::bind_method(D_METHOD("execute_directory", "user_expression_inputs", "base_expression_instance", "user_dir_to_compile"), &GDExpr::execute_directory);
 
-		ClassDB::bind_method(D_METHOD("sort_by_longest", "a", "b"), &GDExpr::sort_by_longest);
+		ClassDB::bind_method(D_METHOD("set_expression_cache_size", "size"), &GDExpr::set_expression_cache_size);
+		ClassDB::bind_method(D_METHOD("get_expression_cache_size"), &GDExpr::get_expression_cache_size);
+		ClassDB::bind_method(D_METHOD("clear_expression_cache"), &GDExpr::clear_expression_cache);
+		ClassDB::bind_method(D_METHOD("set_variables_as_inputs", "enabled"), &GDExpr::set_variables_as_inputs);
+		ClassDB::bind_method(D_METHOD("is_variables_as_inputs"), &GDExpr::is_variables_as_inputs);
+		ClassDB::bind_method(D_METHOD("set_optimize", "enabled"), &GDExpr::set_optimize);
+		ClassDB::bind_method(D_METHOD("is_optimize"), &GDExpr::is_optimize);
+		ClassDB::bind_method(D_METHOD("set_compile_cache_enabled", "enabled"), &GDExpr::set_compile_cache_enabled);
+		ClassDB::bind_method(D_METHOD("is_compile_cache_enabled"), &GDExpr::is_compile_cache_enabled);
+		ClassDB::bind_method(D_METHOD("set_compile_cache_path", "path"), &GDExpr::set_compile_cache_path);
+		ClassDB::bind_method(D_METHOD("get_compile_cache_path"), &GDExpr::get_compile_cache_path);
+		ClassDB::bind_method(D_METHOD("clear_compile_cache"), &GDExpr::clear_compile_cache);
+		ClassDB::bind_method(D_METHOD("set_native_literals", "enabled"), &GDExpr::set_native_literals);
+		ClassDB::bind_method(D_METHOD("is_native_literals"), &GDExpr::is_native_literals);
+		ClassDB::bind_method(D_METHOD("set_nondeterministic_functions", "functions"), &GDExpr::set_nondeterministic_functions);
+		ClassDB::bind_method(D_METHOD("get_nondeterministic_functions"), &GDExpr::get_nondeterministic_functions);
+		ClassDB::bind_method(D_METHOD("set_parallel_directory_compile", "enabled"), &GDExpr::set_parallel_directory_compile);
+		ClassDB::bind_method(D_METHOD("is_parallel_directory_compile"), &GDExpr::is_parallel_directory_compile);
+		ClassDB::bind_method(D_METHOD("set_hot_reload_enabled", "enabled"), &GDExpr::set_hot_reload_enabled);
+		ClassDB::bind_method(D_METHOD("is_hot_reload_enabled"), &GDExpr::is_hot_reload_enabled);
+		ClassDB::bind_method(D_METHOD("check_for_changes"), &GDExpr::check_for_changes);
+		ClassDB::bind_method(D_METHOD("get_changed_programs"), &GDExpr::get_changed_programs);
+		ClassDB::bind_method(D_METHOD("reload_changed_programs"), &GDExpr::reload_changed_programs);
+
+		ADD_PROPERTY(PropertyInfo(Variant::INT, "expression_cache_size"), "set_expression_cache_size", "get_expression_cache_size");
+		ADD_PROPERTY(PropertyInfo(Variant::BOOL, "variables_as_inputs"), "set_variables_as_inputs", "is_variables_as_inputs");
+		ADD_PROPERTY(PropertyInfo(Variant::BOOL, "optimize"), "set_optimize", "is_optimize");
+		ADD_PROPERTY(PropertyInfo(Variant::BOOL, "compile_cache_enabled"), "set_compile_cache_enabled", "is_compile_cache_enabled");
+		ADD_PROPERTY(PropertyInfo(Variant::STRING, "compile_cache_path"), "set_compile_cache_path", "get_compile_cache_path");
+		ADD_PROPERTY(PropertyInfo(Variant::BOOL, "parallel_directory_compile"), "set_parallel_directory_compile", "is_parallel_directory_compile");
+		ADD_PROPERTY(PropertyInfo(Variant::BOOL, "hot_reload_enabled"), "set_hot_reload_enabled", "is_hot_reload_enabled");
+		ADD_PROPERTY(PropertyInfo(Variant::BOOL, "native_literals"), "set_native_literals", "is_native_literals");
+		ADD_PROPERTY(PropertyInfo(Variant::PACKED_STRING_ARRAY, "nondeterministic_functions"), "set_nondeterministic_functions", "get_nondeterministic_functions");
+
+		ADD_SIGNAL(MethodInfo("scripts_changed", PropertyInfo(Variant::PACKED_STRING_ARRAY, "changed_files")));
 	}
 
 public:
-	// Don't use this. It has to be public because it needs to be called from inside expressions.
-	bool sort_by_longest(const String &a, const String &b) const { return a.length() > b.length(); }
+	// Maximum number of parsed expressions kept around between executions. The least recently used expressions are dropped first, 0 disables the cache.
+	void set_expression_cache_size(int p_size) { expression_cache.set_max_size(p_size); }
+	int get_expression_cache_size() const { return expression_cache.get_max_size(); }
+
+	// Drop every cached parsed expression, preprocessed file and compiled include, they will be parsed and compiled again the next time they are used.
+	void clear_expression_cache() {
+		expression_cache.clear();
+		preprocessor_cache.clear();
+		include_cache.clear();
+	}
+
+	// Compile variables to godot expression inputs. Reading a variable is then a plain input lookup inside the expression instead of a get_slot call on the base instance.
+	// Only the expressions compiled to programs can use this, the expressions returned by static_compile always read and write variables by name.
+	void set_variables_as_inputs(bool p_enabled) { variables_as_inputs = p_enabled; }
+	bool is_variables_as_inputs() const { return variables_as_inputs; }
+
+	// Optimize compiled expressions before they are executed. Constant sub expressions are folded into literals and variables that are only ever set to one constant
+	// are replaced with that constant, so their set_slot and get_slot calls disappear. Those variables are then never written to the GDExprScript, which is why
+	// this is off by default.
+	void set_optimize(bool p_enabled) { optimize = p_enabled; }
+	bool is_optimize() const { return optimize; }
+
+	// Store the compiled expressions of every compiled file on disk and reuse them as long as the file and its includes don't change.
+	// Files that run comptime code, themselves or in an include, are never stored since their output can't be keyed.
+	void set_compile_cache_enabled(bool p_enabled) { compile_cache_enabled = p_enabled; }
+	bool is_compile_cache_enabled() const { return compile_cache_enabled; }
+
+	void set_compile_cache_path(const String &p_path) { compile_cache.set_directory(p_path); }
+	String get_compile_cache_path() const { return compile_cache.get_directory(); }
+
+	// Delete every file compiled into the compile cache.
+	void clear_compile_cache() { compile_cache.clear(); }
+
+	// Compile the files of execute_directory and build_bundle on their own, in parallel on the WorkerThreadPool. Files then stop seeing the variables,
+	// comptime variables and macros of the files before them, and comptime code calls base_expression_instance from several threads at once.
+	// When disabled execute_directory compiles the directory as one source and build_bundle compiles one file after another, both on the calling thread.
+	void set_parallel_directory_compile(bool p_enabled) { parallel_directory_compile = p_enabled; }
+	bool is_parallel_directory_compile() const { return parallel_directory_compile; }
+
+	// Track every program compiled with compile_program from now on, with its inputs and instance, so it can be found by get_changed_programs and reloaded by
+	// reload_changed_programs. Tracked programs keep their inputs and instance alive, so this is off unless hot reloading is actually used.
+	// Disabling it forgets every tracked program.
+	void set_hot_reload_enabled(bool p_enabled) {
+		hot_reload_enabled = p_enabled;
+		if (!hot_reload_enabled)
+			change_tracker.clear();
+	}
+	bool is_hot_reload_enabled() const { return hot_reload_enabled; }
 
 	// Statically compile a gdexpr file to a sequence of godot expressions but does not execute them. This works like a static compiler.
 	// If your script does not need runtime data you should always statically compile as it will completely eliminate the compile time cost when running the expressions at
 	// runtime. Returns a PackedStringArray of godot expressions that are ready for execution with the execute_precompiled_expressions function.
 	PackedStringArray static_compile(Array user_expression_inputs, Ref<GDExprScript> base_expression_instance, String user_file_to_compile) {
-		base_instance = base_expression_instance;
-		expression_inputs = user_expression_inputs;
-		file_to_compile = user_file_to_compile;
+		static_compile_instance = base_expression_instance;
+		static_compile_inputs = user_expression_inputs;
+
+		// Precompiled expressions don't carry the names of their variables, so nothing binds a slot layout for them. They read and write variables by name
+		// instead, the same as before variables had slots, so get_var still works after running them and they never write into the slots of another program.
+		CompileContext ctx(user_expression_inputs, base_expression_instance, user_file_to_compile, false, optimize);
+		ctx.named_variables = true;
+		return compile_file(ctx, user_file_to_compile);
+	}
+
+	// Baked results of a config are stored next to it.
+	String get_baked_config_path(const String &config_path) const { return config_path.get_basename() + ".gdexprbaked"; }
+
+	// Returns the first identifier of nondeterministic_functions that p_expressions use, or an empty String if they don't use any.
+	String find_nondeterministic_function(const PackedStringArray &p_expressions) const {
+		HashSet<String> functions;
+		for (int i = 0; i < nondeterministic_functions.size(); ++i) {
+			functions.insert(nondeterministic_functions[i]);
+		}
+
+		LocalVector<ExpressionToken> tokens;
+		for (int i = 0; i < p_expressions.size(); ++i) {
+			tokenize_expression(p_expressions[i], tokens);
+			for (uint32_t j = 0; j < tokens.size(); ++j) {
+				if (tokens[j].type != ExpressionToken::IDENTIFIER)
+					continue;
+
+				const String identifier = p_expressions[i].substr(tokens[j].start, tokens[j].length);
+				if (functions.has(identifier))
+					return identifier;
+			}
+		}
+
+		return String();
+	}
+
+	// Baked results are valid as long as the config and its includes didn't change. A config that isn't there anymore, like in a build that only ships the baked
+	// results, always uses them.
+	bool is_baked_config_valid(const String &config_path, const Dictionary &baked_config) {
+		if (int(baked_config.get("version", -1)) != GDEXPR_COMPILER_VERSION)
+			return false;
+
+		if (!FileAccess::file_exists(config_path))
+			return true;
+
+		if (int64_t(baked_config.get("source_hash", -1)) != int64_t(SourceBuffer(read_file_bytes(config_path)).get_content_hash()))
+			return false;
+
+		const Dictionary include_hashes = baked_config.get("includes", Dictionary());
+		const Array include_paths = include_hashes.keys();
+		for (int i = 0; i < include_paths.size(); ++i) {
+			const String include_path = include_paths[i];
+			if (int64_t(include_hashes[include_path]) != int64_t(SourceBuffer(FileAccess::get_file_as_bytes(include_path)).get_content_hash()))
+				return false;
+		}
+
+		return true;
+	}
+
+	// Compile a gdexpr file into a GDExprProgram that holds the compiled and already parsed expressions.
+	// The program can then be executed any number of times with GDExprProgram.execute without compiling or parsing anything again.
+	// input_names are the names the expressions can use to refer to the inputs passed into GDExprProgram.execute.
+	Ref<GDExprProgram> compile_program(
+			Array user_expression_inputs, Ref<GDExprScript> base_expression_instance, String user_file_to_compile, PackedStringArray input_names = PackedStringArray()) {
+		CompileContext ctx(user_expression_inputs, base_expression_instance, user_file_to_compile, variables_as_inputs, optimize);
+		PackedStringArray compiled_expressions = compile_file(ctx, user_file_to_compile);
+		Ref<GDExprProgram> program = create_program_from_expressions(ctx, compiled_expressions, input_names, user_file_to_compile);
+		if (hot_reload_enabled)
+			change_tracker.track_program(program, ctx, input_names);
+
+		return program;
+	}
+
+	// Same as compile_program but the file is read and compiled on the WorkerThreadPool, including its includes and comptime code.
+	// Returns a GDExprCompileTask that can be polled or waited on and emits completed with the program on the main thread once it is done.
+	// NOTE: Comptime code runs on a worker thread, so the functions it calls on base_expression_instance must be safe to call from another thread.
+	Ref<GDExprCompileTask> compile_program_async(
+			Array user_expression_inputs, Ref<GDExprScript> base_expression_instance, String user_file_to_compile, PackedStringArray input_names = PackedStringArray()) {
+		Ref<GDExprCompileTask> task;
+		task.instantiate();
+		task->start(Ref<GDExpr>(this), user_expression_inputs, base_expression_instance, user_file_to_compile, input_names);
+		return task;
+	}
+
+	// Comptime code is executed while compiling and folded into literals, so it never shows up in the compiled expressions. Scan the preprocessed lines of the
+	// config and of every file it included as well, that way a comptime var, condition or macro that uses one of nondeterministic_functions is still found.
+	String find_nondeterministic_function_in_sources(const CompileContext &ctx, const String &config_path) {
+		PackedStringArray source_paths;
+		source_paths.append(config_path);
+		for (const KeyValue<String, uint32_t> &E : ctx.included_file_hashes) {
+			source_paths.append(E.key);
+		}
+
+		for (int i = 0; i < source_paths.size(); ++i) {
+			SourceBuffer source = parse_file(source_paths[i]);
+			LocalVector<SourceToken> source_tokens;
+			source.tokenize(source_tokens);
+
+			PackedInt32Array line_numbers;
+			MacroPreprocessor preprocessor;
+			const Vector<PackedStringArray> lines = preprocessor.preprocess(source, source_tokens, line_numbers);
+			PackedStringArray source_lines;
+			for (int j = 0; j < lines.size(); ++j) {
+				source_lines.append(String(" ").join(lines[j]));
+			}
+
+			const String nondeterministic_function = find_nondeterministic_function(source_lines);
+			if (!nondeterministic_function.is_empty())
+				return nondeterministic_function;
+		}
+
+		return String();
+	}
+
+	// Compile and execute a config once and store its results next to it with var_to_bytes, see load_baked_config. Returns the results.
+	// Configs that use one of nondeterministic_functions return different results every time, so they are executed but never baked. That includes
+	// functions only called by comptime code, whose results would otherwise be frozen into the baked file.
+	Array bake_config(String config_path) {
+		CompileContext ctx(Array(), Ref<GDExprScript>(), config_path, variables_as_inputs, optimize);
+		PackedStringArray compiled_expressions = compile_file(ctx, config_path);
+		Array results = create_program_from_expressions(ctx, compiled_expressions, PackedStringArray(), config_path)->execute(Array(), Ref<GDExprScript>());
+
+		String nondeterministic_function = find_nondeterministic_function(compiled_expressions);
+		if (nondeterministic_function.is_empty())
+			nondeterministic_function = find_nondeterministic_function_in_sources(ctx, config_path);
+
+		if (!nondeterministic_function.is_empty()) {
+			UtilityFunctions::print_verbose(vformat("GDExpr config \"%s\" isn't baked because it uses %s.", config_path, nondeterministic_function));
+			return results;
+		}
 
-		return compile_file(file_to_compile);
+		Dictionary include_hashes;
+		for (const KeyValue<String, uint32_t> &E : ctx.included_file_hashes) {
+			include_hashes[E.key] = int64_t(E.value);
+		}
+
+		Dictionary baked_config;
+		baked_config["version"] = GDEXPR_COMPILER_VERSION;
+		baked_config["source_hash"] = int64_t(ctx.source_hash);
+		baked_config["includes"] = include_hashes;
+		baked_config["results"] = results;
+
+		const String baked_path = get_baked_config_path(config_path);
+		Ref<FileAccess> file = FileAccess::open(baked_path, FileAccess::WRITE);
+		ERR_FAIL_COND_V_MSG(file.is_null(), results, vformat("GDExpr can't write baked config to \"%s\".", baked_path));
+		file->store_buffer(UtilityFunctions::var_to_bytes(baked_config));
+		return results;
+	}
+
+	// Returns the results of a config without compiling or executing it when it was baked with bake_config and didn't change since, it is baked again otherwise.
+	Array load_baked_config(String config_path) {
+		const String baked_path = get_baked_config_path(config_path);
+		if (FileAccess::file_exists(baked_path)) {
+			const Dictionary baked_config = UtilityFunctions::bytes_to_var(FileAccess::get_file_as_bytes(baked_path));
+			if (is_baked_config_valid(config_path, baked_config))
+				return baked_config.get("results", Array());
+		}
+
+		return bake_config(config_path);
+	}
+
+	// Turn expressions that are nothing but a literal into their value when a program is created instead of parsing them into an Expression, see LiteralParser.
+	// Off by default until it is measured against the Expression path.
+	void set_native_literals(bool p_enabled) { native_literals = p_enabled; }
+	bool is_native_literals() const { return native_literals; }
+
+	// Identifiers that make a config return different results every time it is executed, configs that use any of them are never baked.
+	void set_nondeterministic_functions(const PackedStringArray &p_functions) { nondeterministic_functions = p_functions; }
+	PackedStringArray get_nondeterministic_functions() const { return nondeterministic_functions; }
+
+	// Create a GDExprProgram from expressions that were precompiled with the static_compile function.
+	Ref<GDExprProgram> create_program(PackedStringArray compiled_expressions, PackedStringArray input_names = PackedStringArray()) {
+		CompileContext ctx(Array(), Ref<GDExprScript>(), String(), false);
+		return create_program_from_expressions(ctx, compiled_expressions, input_names, String());
+	}
+
+	// Save a compiled program to a binary .gdexprc file that load_program can load without compiling anything, see CompiledProgramFormat.
+	Error save_program(Ref<GDExprProgram> program, String path) {
+		ERR_FAIL_COND_V(program.is_null(), ERR_INVALID_PARAMETER);
+		Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE);
+		ERR_FAIL_COND_V_MSG(file.is_null(), FileAccess::get_open_error(), vformat("GDExpr can't write program to \"%s\".", path));
+
+		file->store_buffer(CompiledProgramFormat::encode(program->get_program_data()));
+		return file->get_error();
+	}
+
+	// Load a program saved with save_program. The whole file is read at once and the expressions are only parsed, there is no gdexpr source to compile.
+	Ref<GDExprProgram> load_program(String path) {
+		CompiledProgramData program_data;
+		ERR_FAIL_COND_V_MSG(!CompiledProgramFormat::decode(read_file_bytes(path), program_data), Ref<GDExprProgram>(),
+				vformat("GDExpr can't load program from \"%s\", it isn't a compiled gdexpr program of this version.", path));
+
+		return create_program_from_data(program_data);
+	}
+
+	// Parse a program that was saved or bundled into a new GDExprProgram.
+	Ref<GDExprProgram> create_program_from_data(const CompiledProgramData &p_program_data) {
+		Ref<GDExprProgram> program;
+		program.instantiate();
+		fill_program(program, p_program_data);
+		return program;
+	}
+
+	// Compile every gdexpr file in dir_path on its own, in parallel if parallel_directory_compile is enabled, and pack them into one bundle file at bundle_path.
+	// Every program is compressed with compression_mode, a FileAccess.CompressionMode, unless it is -1 or compressing doesn't make the program smaller.
+	Error build_bundle(String dir_path, String bundle_path, int compression_mode = -1, Array user_expression_inputs = Array(),
+			Ref<GDExprScript> base_expression_instance = Ref<GDExprScript>()) {
+		const PackedStringArray file_paths = get_directory_files(dir_path);
+		Ref<GDExprDirectoryTask> task;
+		task.instantiate();
+		task->setup(Ref<GDExpr>(this), user_expression_inputs, base_expression_instance, variables_as_inputs, optimize, file_paths);
+		run_directory_task(task, "GDExpr bundle compile");
+
+		LocalVector<BundleEntry> entries;
+		HashMap<String, PackedByteArray> entry_data;
+		for (int i = 0; i < file_paths.size(); ++i) {
+			CompiledProgramData program_data;
+			program_data.expressions = task->get_file_expressions(i);
+			program_data.variable_names = task->get_file_variable_names(i);
+			program_data.source_path = file_paths[i];
+			program_data.variables_as_inputs = variables_as_inputs;
+			program_data.source_map = task->get_file_source_map(i);
+
+			BundleEntry entry;
+			entry.path = file_paths[i].get_file();
+			entry.path_hash = entry.path.hash();
+
+			PackedByteArray data = CompiledProgramFormat::encode(program_data);
+			entry.decompressed_size = data.size();
+			if (compression_mode >= 0) {
+				PackedByteArray compressed_data = data.compress(compression_mode);
+				if (compressed_data.size() < data.size()) {
+					data = compressed_data;
+					entry.compression_mode = compression_mode;
+				}
+			}
+
+			entry.size = data.size();
+			entries.push_back(entry);
+			entry_data.insert(entry.path, data);
+		}
+
+		const PackedByteArray index = BundleFormat::encode_index(entries);
+		Ref<FileAccess> file = FileAccess::open(bundle_path, FileAccess::WRITE);
+		ERR_FAIL_COND_V_MSG(file.is_null(), FileAccess::get_open_error(), vformat("GDExpr can't write bundle to \"%s\".", bundle_path));
+
+		file->store_buffer(index);
+		for (uint32_t i = 0; i < entries.size(); ++i) {
+			file->store_buffer(entry_data[entries[i].path]);
+		}
+
+		return file->get_error();
+	}
+
+	// Open a bundle built with build_bundle. Only its index is read, the programs are loaded when they are first used.
+	Ref<GDExprBundle> open_bundle(String path) {
+		Ref<GDExprBundle> bundle;
+		bundle.instantiate();
+		if (bundle->open(path) != OK)
+			return Ref<GDExprBundle>();
+
+		return bundle;
+	}
+
+	// Check every file the programs compiled with compile_program depend on for changes since the last check. Emits scripts_changed if any file changed.
+	// Only programs compiled while hot_reload_enabled is on are tracked.
+	// Only files with a new modified time are read again, and they only count as changed if their content did.
+	// Returns the paths of the files that changed.
+	PackedStringArray check_for_changes() {
+		PackedStringArray changed_files = change_tracker.check_for_changes();
+		if (!changed_files.is_empty())
+			emit_signal("scripts_changed", changed_files);
+
+		return changed_files;
 	}
 
-	// TODO - create some kind of algorithm that is able to report gdexpr files that have changed since the last compile so users can write code that allows pre compiling and
-	// also hot reloading. Not sure if this should actually be in the compiler or in a seperate interface though...it should be possible to do it outside of the compiler.
-	// NOTE: I actually already did this in python in the check_mod_for changes function of game_objects.py found here:
-	// https://github.com/dementive/JominiTools/blob/64b6b9da14fe766b7d881e56b903c7c01264e853/src/game_objects.py#L25
-	// The algorithm should work the same, just check os.stat of each compiled file, cache the value, and then have a "script_changed" signal send from somewhere that will
-	// recheck os.stat to see if the file was changed. This would probably require some kind of cache to store the os.stat values to be implemented too, that is how
-	// JominiTools pulls it off.
+	// Check for changes and return every program compiled with compile_program that depends on a changed file and wasn't reloaded since.
+	Array get_changed_programs() {
+		check_for_changes();
+		return change_tracker.get_changed_programs();
+	}
+
+	// Compile every changed program again, in place, with the inputs and instance it was first compiled with. Programs that don't depend on a changed file are
+	// left alone and includes that didn't change are still preprocessed from the cache, so changing one include only recompiles the programs that include it.
+	// Returns the programs that were reloaded.
+	Array reload_changed_programs() {
+		Array changed_programs = get_changed_programs();
+		for (int i = 0; i < changed_programs.size(); ++i) {
+			Ref<GDExprProgram> program = changed_programs[i];
+			Array inputs;
+			Ref<GDExprScript> instance;
+			PackedStringArray input_names;
+			if (!change_tracker.get_program_info(program, inputs, instance, input_names))
+				continue;
+
+			CompileContext ctx(inputs, instance, program->get_source_path(), variables_as_inputs, optimize);
+			PackedStringArray compiled_expressions = compile_file(ctx, program->get_source_path());
+			fill_program(ctx, program, compiled_expressions, input_names, program->get_source_path());
+			change_tracker.track_program(program, ctx, input_names);
+		}
+
+		return changed_programs;
+	}
 
 	// Execute a sequence of expressions that were precompiled with the static_compile function.
+	// The expressions are executed with user_expression_inputs and base_expression_instance, if no instance is given the inputs and instance of the last
+	// static_compile call are used instead. Prefer create_program for precompiled expressions, a program doesn't depend on what was compiled last.
 	// Returns the results of each expression executed in an Array.
-	Array execute_precompiled_expressions(PackedStringArray compiled_expression, String string_to_execute) {
-		return _execute_expressions(compiled_expression, file_to_compile, true);
+	Array execute_precompiled_expressions(PackedStringArray compiled_expression, String string_to_execute, Array user_expression_inputs = Array(),
+			Ref<GDExprScript> base_expression_instance = Ref<GDExprScript>()) {
+		if (base_expression_instance.is_null()) {
+			base_expression_instance = static_compile_instance;
+			user_expression_inputs = static_compile_inputs;
+		}
+
+		CompileContext ctx(user_expression_inputs, base_expression_instance, String(), false);
+		return _execute_expressions(ctx, compiled_expression, true);
+	}
+
+	// Start a resumable execution of a compiled program. Nothing is executed until GDExprExecution.step is called.
+	Ref<GDExprExecution> create_execution(Ref<GDExprProgram> program, Array inputs, Ref<GDExprScript> instance) {
+		ERR_FAIL_COND_V(program.is_null(), Ref<GDExprExecution>());
+		Ref<GDExprExecution> execution;
+		execution.instantiate();
+		execution->setup(program, inputs, instance);
+		return execution;
 	}
 
 	// Compiles a String with GDExpr code in it to a sequence of godot expressions and execute them.
 	// Returns the results of each expression executed in an Array.
 	Array execute(Array user_expression_inputs, Ref<GDExprScript> base_expression_instance, String string_to_execute) {
-		base_instance = base_expression_instance;
-		expression_inputs = user_expression_inputs;
+		CompileContext ctx(user_expression_inputs, base_expression_instance, String(), variables_as_inputs, optimize);
 #ifdef GDEXPR_COMPILER_TIMING_DEBUG
-		TIME_MICRO(compile, PackedStringArray compiled_expression = compile(string_to_execute))
-		return _execute_expressions(compiled_expression, file_to_compile, true);
+		TIME_MICRO(compile, PackedStringArray compiled_expression = compile_source(ctx, string_to_execute))
+		return _execute_expressions(ctx, compiled_expression, true);
 #else
-		PackedStringArray compiled_expression = compile(file_to_compile);
-		return _execute_expressions(compiled_expression, file_to_compile, true);
+		PackedStringArray compiled_expression = compile_source(ctx, string_to_execute);
+		return _execute_expressions(ctx, compiled_expression, true);
 #endif
 	}
 
+	// Execute a compiled program once for every GDExprScript in contexts, all in one call.
+	// inputs_per_context is either empty or has the inputs Array of each context.
+	// Returns one Array per expression index that holds the result of that expression for every context, in the same order as contexts.
+	Array execute_batch(Ref<GDExprProgram> program, TypedArray<GDExprScript> contexts, Array inputs_per_context = Array()) {
+		ERR_FAIL_COND_V(program.is_null(), Array());
+		return program->execute_batch(contexts, inputs_per_context);
+	}
+
+	// Same as execute_batch but the contexts are split into chunks of grain_size contexts that are executed in parallel on the WorkerThreadPool.
+	// A grain_size of 0 picks one that gives every thread a few chunks so the threads that finish early can take over the remaining work.
+	// Every thread uses its own parsed copy of the program and the results are in the same order as contexts, the same as execute_batch.
+	// NOTE: The functions called by the program are called from worker threads, so they must be safe to call from several threads at once on different contexts.
+	Array execute_batch_parallel(Ref<GDExprProgram> program, TypedArray<GDExprScript> contexts, Array inputs_per_context = Array(), int grain_size = 0) {
+		ERR_FAIL_COND_V(program.is_null(), Array());
+		ERR_FAIL_COND_V_MSG(!inputs_per_context.is_empty() and inputs_per_context.size() != contexts.size(), Array(),
+				"GDExpr batch execution needs either no inputs or one inputs Array per context.");
+
+		if (grain_size <= 0)
+			grain_size = MAX(1, int(contexts.size()) / (OS::get_singleton()->get_processor_count() * 4));
+
+		Ref<GDExprBatchTask> task;
+		task.instantiate();
+		task->setup(program, contexts, inputs_per_context, grain_size);
+
+		WorkerThreadPool *thread_pool = WorkerThreadPool::get_singleton();
+		int64_t group_id = thread_pool->add_group_task(callable_mp(task.ptr(), &GDExprBatchTask::run_chunk), task->get_chunk_count(), -1, true, "GDExpr batch execution");
+		thread_pool->wait_for_group_task_completion(group_id);
+
+		return task->get_results();
+	}
+
 	// Compile a gdexpr file to a sequence of godot expressions and execute them.
 	// Returns the results of each expression executed in an Array.
 	Array execute_file(Array user_expression_inputs, Ref<GDExprScript> base_expression_instance, String user_file_to_compile) {
-		base_instance = base_expression_instance;
-		expression_inputs = user_expression_inputs;
-		file_to_compile = user_file_to_compile;
+		CompileContext ctx(user_expression_inputs, base_expression_instance, user_file_to_compile, variables_as_inputs, optimize);
 #ifdef GDEXPR_COMPILER_TIMING_DEBUG
-		TIME_MICRO(compile, PackedStringArray compiled_expression = compile_file(file_to_compile))
-		return _execute_expressions(compiled_expression, file_to_compile, false);
+		TIME_MICRO(compile, PackedStringArray compiled_expression = compile_file(ctx, user_file_to_compile))
+		return _execute_expressions(ctx, compiled_expression, false);
 #else
-		PackedStringArray compiled_expression = compile_file(file_to_compile);
-		return _execute_expressions(compiled_expression, file_to_compile, false);
+		PackedStringArray compiled_expression = compile_file(ctx, user_file_to_compile);
+		return _execute_expressions(ctx, compiled_expression, false);
 #endif
 	}
 
 	// Search a directory for gdexpr files to compile then execute them.
 	// This will process each gdexpr file in the directory
 	// So be careful not to put gdexpr files that are only meant to be used as includes in the execution directory when using this function.
+	// The files are compiled in file name order as one source on the calling thread, so every file sees the variables, comptime variables and macros of the
+	// files before it. With parallel_directory_compile every file is compiled on its own in parallel instead, see compile_directory.
 	// Returns the results of each expression executed in an Array.
 	Array execute_directory(Array user_expression_inputs, Ref<GDExprScript> base_expression_instance, String user_dir_to_compile) {
-		base_instance = base_expression_instance;
-		expression_inputs = user_expression_inputs;
-		file_to_compile = user_dir_to_compile;
+		CompileContext ctx(user_expression_inputs, base_expression_instance, user_dir_to_compile, variables_as_inputs, optimize);
 #ifdef GDEXPR_COMPILER_TIMING_DEBUG
-		TIME_MICRO(compile_directory, PackedStringArray compiled_expression = compile_directory(file_to_compile))
-		return _execute_expressions(compiled_expression, file_to_compile, false);
+		TIME_MICRO(compile_directory, PackedStringArray compiled_expression = compile_directory(ctx, user_dir_to_compile))
+		return _execute_expressions(ctx, compiled_expression, false);
 #else
-		PackedStringArray compiled_expression = compile_directory(file_to_compile);
-		return _execute_expressions(compiled_expression, file_to_compile, false);
+		PackedStringArray compiled_expression = compile_directory(ctx, user_dir_to_compile);
+		return _execute_expressions(ctx, compiled_expression, false);
 #endif
 	}
 };
 
+inline void GDExprCompileTask::run() {
+	program = compiler->compile_program(inputs, instance, source_path, input_names);
+	callable_mp(this, &GDExprCompileTask::finish_on_main_thread).call_deferred();
+}
+
+inline Ref<GDExprProgram> GDExprBundle::load_program(const String &p_path) {
+	{
+		MutexLock lock(*mutex.ptr());
+		const Ref<GDExprProgram> *program = loaded_programs.getptr(p_path);
+		if (program != nullptr)
+			return *program;
+	}
+
+	CompiledProgramData program_data;
+	ERR_FAIL_COND_V_MSG(!read_program_data(p_path, program_data), Ref<GDExprProgram>(), vformat("GDExpr bundle \"%s\" has no valid program \"%s\".", bundle_path, p_path));
+
+	Ref<GDExprProgram> program = GDExpr::get_singleton()->create_program_from_data(program_data);
+	MutexLock lock(*mutex.ptr());
+	loaded_programs.insert(p_path, program);
+	return program;
+}
+
+inline void GDExprDirectoryTask::compile_file(uint32_t p_file) {
+	CompileContext ctx(inputs, instance, file_paths[p_file], variables_as_inputs, optimize);
+	file_expressions_ptr[p_file] = compiler->compile_file(ctx, file_paths[p_file]);
+	file_variable_names_ptr[p_file] = ctx.variable_slot_names;
+	file_source_maps_ptr[p_file] = ctx.source_map;
+}
+
 } //namespace gdexpr
 
 #endif // GDExpr_H
@@ -0,0 +1,402 @@
+#ifndef GDExprFormat_H
+#define GDExprFormat_H
+
+#include "godot_cpp/templates/hash_map.hpp"
+#include "godot_cpp/templates/local_vector.hpp"
+#include "godot_cpp/templates/vector.hpp"
+#include "godot_cpp/variant/variant.hpp"
+
+using namespace godot;
+
+namespace gdexpr {
+
+// Little endian numbers of the binary formats. The writers move r_ptr past what they wrote, the readers read at p_offset.
+_ALWAYS_INLINE_ void write_u32(uint8_t *&r_ptr, uint32_t p_value) {
+	r_ptr[0] = p_value & 0xFF;
+	r_ptr[1] = (p_value >> 8) & 0xFF;
+	r_ptr[2] = (p_value >> 16) & 0xFF;
+	r_ptr[3] = (p_value >> 24) & 0xFF;
+	r_ptr += 4;
+}
+
+_ALWAYS_INLINE_ void write_u64(uint8_t *&r_ptr, uint64_t p_value) {
+	write_u32(r_ptr, p_value & 0xFFFFFFFF);
+	write_u32(r_ptr, p_value >> 32);
+}
+
+_ALWAYS_INLINE_ uint32_t read_u32(const uint8_t *p_ptr, uint64_t p_offset) {
+	p_ptr += p_offset;
+	return uint32_t(p_ptr[0]) | (uint32_t(p_ptr[1]) << 8) | (uint32_t(p_ptr[2]) << 16) | (uint32_t(p_ptr[3]) << 24);
+}
+
+_ALWAYS_INLINE_ uint64_t read_u64(const uint8_t *p_ptr, uint64_t p_offset) { return uint64_t(read_u32(p_ptr, p_offset)) | (uint64_t(read_u32(p_ptr, p_offset + 4)) << 32); }
+
+// Where every compiled expression comes from, in expression order. Lines start at 1, a line of 0 means the expression has no known source line.
+struct SourceMap {
+	PackedStringArray files;
+	PackedInt32Array lines;
+
+	int size() const { return lines.size(); }
+
+	void add(const String &p_file, int p_line) {
+		files.append(p_file);
+		lines.append(p_line);
+	}
+
+	void append(const SourceMap &p_source_map) {
+		files.append_array(p_source_map.files);
+		lines.append_array(p_source_map.lines);
+	}
+
+	// Entries past p_size are dropped, missing entries are added without a source.
+	void resize(int p_size) {
+		files.resize(p_size);
+		lines.resize(p_size);
+	}
+
+	SourceMap slice(int p_begin) const {
+		SourceMap source_map;
+		source_map.files = files.slice(p_begin);
+		source_map.lines = lines.slice(p_begin);
+		return source_map;
+	}
+
+	void clear() {
+		files.clear();
+		lines.clear();
+	}
+};
+
+// Everything a compiled program is made of, what save_program writes and load_program reads.
+struct CompiledProgramData {
+	PackedStringArray expressions;
+	PackedStringArray input_names;
+	PackedStringArray variable_names;
+	String source_path;
+	bool variables_as_inputs = false;
+	SourceMap source_map;
+};
+
+// The binary .gdexprc format of a compiled program. Every number is a little endian uint32 and every string is an index into the string table, so strings
+// that show up several times, like the file of every entry of the source map, are only stored once.
+//
+// Header:        magic "GDXC", format version, flags, string count, string data size, expression count, input name count, variable name count,
+//                source path.
+// String table:  offset and length of every string in the string data, followed by the string data, every string is UTF-8 without a terminator.
+// Expressions:   one string per expression.
+// Inputs:        one string per input name.
+// Variables:     one string per variable slot, in slot order.
+// Source map:    file and line of every expression.
+class CompiledProgramFormat {
+	static const uint32_t FORMAT_VERSION = 1;
+	static const uint32_t HEADER_SIZE = 9 * 4;
+	static const uint32_t FLAG_VARIABLES_AS_INPUTS = 1 << 0;
+
+	// Strings in the order they were added and the index of each one, every string is only added once.
+	struct StringTable {
+		PackedStringArray strings;
+		HashMap<String, uint32_t> indices;
+
+		uint32_t add(const String &p_string) {
+			const uint32_t *index = indices.getptr(p_string);
+			if (index != nullptr)
+				return *index;
+
+			const uint32_t new_index = strings.size();
+			strings.append(p_string);
+			indices.insert(p_string, new_index);
+			return new_index;
+		}
+	};
+
+	// Read p_count string indices starting at r_offset into r_strings. Returns false if an index is out of the string table.
+	static bool read_strings(const uint8_t *p_ptr, uint32_t &r_offset, uint32_t p_count, const Vector<String> &p_strings, PackedStringArray &r_strings) {
+		r_strings.resize(p_count);
+		String *strings = r_strings.ptrw();
+		for (uint32_t i = 0; i < p_count; ++i, r_offset += 4) {
+			const uint32_t index = read_u32(p_ptr, r_offset);
+			if (index >= uint32_t(p_strings.size()))
+				return false;
+
+			strings[i] = p_strings[index];
+		}
+
+		return true;
+	}
+
+public:
+	static PackedByteArray encode(const CompiledProgramData &p_program) {
+		const uint32_t expression_count = p_program.expressions.size();
+		StringTable string_table;
+		LocalVector<uint32_t> expressions;
+		LocalVector<uint32_t> input_names;
+		LocalVector<uint32_t> variable_names;
+		LocalVector<uint32_t> source_files;
+		for (uint32_t i = 0; i < expression_count; ++i) {
+			expressions.push_back(string_table.add(p_program.expressions[i]));
+		}
+
+		for (int i = 0; i < p_program.input_names.size(); ++i) {
+			input_names.push_back(string_table.add(p_program.input_names[i]));
+		}
+
+		for (int i = 0; i < p_program.variable_names.size(); ++i) {
+			variable_names.push_back(string_table.add(p_program.variable_names[i]));
+		}
+
+		const uint32_t source_path = string_table.add(p_program.source_path);
+		for (uint32_t i = 0; i < expression_count; ++i) {
+			source_files.push_back(string_table.add(int(i) < p_program.source_map.size() ? p_program.source_map.files[i] : String()));
+		}
+
+		Vector<CharString> string_data;
+		uint32_t string_data_size = 0;
+		for (int i = 0; i < string_table.strings.size(); ++i) {
+			string_data.push_back(string_table.strings[i].utf8());
+			string_data_size += string_data[i].length();
+		}
+
+		const uint32_t string_count = string_data.size();
+		const uint32_t size = HEADER_SIZE + string_count * 8 + string_data_size + (expression_count + input_names.size() + variable_names.size() + expression_count * 2) * 4;
+		PackedByteArray bytes;
+		bytes.resize(size);
+		uint8_t *ptr = bytes.ptrw();
+
+		memcpy(ptr, "GDXC", 4);
+		ptr += 4;
+		write_u32(ptr, FORMAT_VERSION);
+		write_u32(ptr, p_program.variables_as_inputs ? FLAG_VARIABLES_AS_INPUTS : 0);
+		write_u32(ptr, string_count);
+		write_u32(ptr, string_data_size);
+		write_u32(ptr, expression_count);
+		write_u32(ptr, input_names.size());
+		write_u32(ptr, variable_names.size());
+		write_u32(ptr, source_path);
+
+		uint32_t string_offset = 0;
+		for (uint32_t i = 0; i < string_count; ++i) {
+			write_u32(ptr, string_offset);
+			write_u32(ptr, string_data[i].length());
+			string_offset += string_data[i].length();
+		}
+
+		for (uint32_t i = 0; i < string_count; ++i) {
+			memcpy(ptr, string_data[i].get_data(), string_data[i].length());
+			ptr += string_data[i].length();
+		}
+
+		for (uint32_t i = 0; i < expression_count; ++i) {
+			write_u32(ptr, expressions[i]);
+		}
+
+		for (uint32_t i = 0; i < input_names.size(); ++i) {
+			write_u32(ptr, input_names[i]);
+		}
+
+		for (uint32_t i = 0; i < variable_names.size(); ++i) {
+			write_u32(ptr, variable_names[i]);
+		}
+
+		for (uint32_t i = 0; i < expression_count; ++i) {
+			write_u32(ptr, source_files[i]);
+			write_u32(ptr, int(i) < p_program.source_map.size() ? uint32_t(p_program.source_map.lines[i]) : 0);
+		}
+
+		return bytes;
+	}
+
+	// Decode a program encoded with encode. Every string is decoded straight from p_bytes once, no matter how often the program uses it.
+	// Returns false if p_bytes isn't a valid program of this format version.
+	static bool decode(const PackedByteArray &p_bytes, CompiledProgramData &r_program) {
+		const uint8_t *ptr = p_bytes.ptr();
+		const uint64_t size = p_bytes.size();
+		if (size < HEADER_SIZE or memcmp(ptr, "GDXC", 4) != 0 or read_u32(ptr, 4) != FORMAT_VERSION)
+			return false;
+
+		const uint32_t flags = read_u32(ptr, 8);
+		const uint32_t string_count = read_u32(ptr, 12);
+		const uint32_t string_data_size = read_u32(ptr, 16);
+		const uint32_t expression_count = read_u32(ptr, 20);
+		const uint32_t input_name_count = read_u32(ptr, 24);
+		const uint32_t variable_name_count = read_u32(ptr, 28);
+		const uint32_t source_path = read_u32(ptr, 32);
+
+		const uint64_t string_data_offset = HEADER_SIZE + uint64_t(string_count) * 8;
+		const uint64_t tables_size = (uint64_t(expression_count) * 3 + input_name_count + variable_name_count) * 4;
+		if (string_data_offset + string_data_size + tables_size != size or source_path >= string_count)
+			return false;
+
+		Vector<String> strings;
+		strings.resize(string_count);
+		String *strings_ptr = strings.ptrw();
+		for (uint32_t i = 0; i < string_count; ++i) {
+			const uint32_t offset = read_u32(ptr, HEADER_SIZE + i * 8);
+			const uint32_t length = read_u32(ptr, HEADER_SIZE + i * 8 + 4);
+			if (uint64_t(offset) + length > string_data_size)
+				return false;
+
+			strings_ptr[i] = String::utf8((const char *)ptr + string_data_offset + offset, length);
+		}
+
+		uint32_t offset = string_data_offset + string_data_size;
+		if (!read_strings(ptr, offset, expression_count, strings, r_program.expressions) or !read_strings(ptr, offset, input_name_count, strings, r_program.input_names) or
+				!read_strings(ptr, offset, variable_name_count, strings, r_program.variable_names))
+			return false;
+
+		r_program.source_map.clear();
+		for (uint32_t i = 0; i < expression_count; ++i, offset += 8) {
+			const uint32_t file = read_u32(ptr, offset);
+			if (file >= string_count)
+				return false;
+
+			r_program.source_map.add(strings[file], int(read_u32(ptr, offset + 4)));
+		}
+
+		r_program.source_path = strings[source_path];
+		r_program.variables_as_inputs = flags & FLAG_VARIABLES_AS_INPUTS;
+		return true;
+	}
+};
+
+// An entry of a bundle, see BundleFormat.
+struct BundleEntry {
+	uint32_t path_hash = 0;
+	String path;
+	int compression_mode = -1; // A FileAccess::CompressionMode, or -1 if the entry isn't compressed.
+	uint64_t offset = 0; // Where the data of the entry starts in the bundle file.
+	uint32_t size = 0; // Size of the data in the bundle file.
+	uint32_t decompressed_size = 0; // Size of the encoded program once it is decompressed.
+
+	bool operator<(const BundleEntry &p_entry) const { return path_hash < p_entry.path_hash or (path_hash == p_entry.path_hash and path < p_entry.path); }
+};
+
+// The binary .gdexprb bundle format, many compiled programs in one file. Everything but the programs themselves is at the start of the file so opening a
+// bundle is a single read, programs are read one at a time when they are first used.
+//
+// Header:     magic "GDXB", format version, entry count, path data size.
+// Index:      path hash, path offset, path length, compression mode, data offset (uint64), data size and decompressed size of every entry, sorted by
+//             path hash so entries are found with a binary search.
+// Path data:  UTF-8 path of every entry.
+// Entries:    every program encoded with CompiledProgramFormat, compressed with its compression mode if it has one.
+class BundleFormat {
+	static const uint32_t FORMAT_VERSION = 1;
+	static const uint32_t NO_COMPRESSION = 0xFFFFFFFF;
+	static const uint32_t INDEX_ENTRY_SIZE = 8 * 4;
+
+public:
+	static const uint32_t HEADER_SIZE = 4 * 4;
+
+	// Sort the entries, give them their offsets and encode everything that comes before the entry data. The entry data has to be written right after it in the
+	// order of r_entries.
+	static PackedByteArray encode_index(LocalVector<BundleEntry> &r_entries) {
+		r_entries.sort();
+
+		Vector<CharString> paths;
+		uint32_t path_data_size = 0;
+		for (uint32_t i = 0; i < r_entries.size(); ++i) {
+			paths.push_back(r_entries[i].path.utf8());
+			path_data_size += paths[i].length();
+		}
+
+		const uint32_t index_size = HEADER_SIZE + r_entries.size() * INDEX_ENTRY_SIZE + path_data_size;
+		PackedByteArray bytes;
+		bytes.resize(index_size);
+		uint8_t *ptr = bytes.ptrw();
+
+		memcpy(ptr, "GDXB", 4);
+		ptr += 4;
+		write_u32(ptr, FORMAT_VERSION);
+		write_u32(ptr, r_entries.size());
+		write_u32(ptr, path_data_size);
+
+		uint32_t path_offset = 0;
+		uint64_t data_offset = index_size;
+		for (uint32_t i = 0; i < r_entries.size(); ++i) {
+			BundleEntry &entry = r_entries[i];
+			entry.offset = data_offset;
+			data_offset += entry.size;
+
+			write_u32(ptr, entry.path_hash);
+			write_u32(ptr, path_offset);
+			write_u32(ptr, paths[i].length());
+			write_u32(ptr, entry.compression_mode < 0 ? NO_COMPRESSION : uint32_t(entry.compression_mode));
+			write_u64(ptr, entry.offset);
+			write_u32(ptr, entry.size);
+			write_u32(ptr, entry.decompressed_size);
+			path_offset += paths[i].length();
+		}
+
+		for (uint32_t i = 0; i < r_entries.size(); ++i) {
+			memcpy(ptr, paths[i].get_data(), paths[i].length());
+			ptr += paths[i].length();
+		}
+
+		return bytes;
+	}
+
+	// Returns the size of everything after the header that decode_index needs, or -1 if p_header isn't the header of a bundle of this format version.
+	static int64_t get_index_size(const PackedByteArray &p_header) {
+		const uint8_t *ptr = p_header.ptr();
+		if (p_header.size() < HEADER_SIZE or memcmp(ptr, "GDXB", 4) != 0 or read_u32(ptr, 4) != FORMAT_VERSION)
+			return -1;
+
+		return int64_t(read_u32(ptr, 8)) * INDEX_ENTRY_SIZE + read_u32(ptr, 12);
+	}
+
+	// Decode the index that follows p_header. Returns false if it is cut short or an entry is out of p_file_size.
+	static bool decode_index(const PackedByteArray &p_header, const PackedByteArray &p_index, uint64_t p_file_size, LocalVector<BundleEntry> &r_entries) {
+		const uint32_t entry_count = read_u32(p_header.ptr(), 8);
+		const uint32_t path_data_size = read_u32(p_header.ptr(), 12);
+		const uint64_t path_data_offset = uint64_t(entry_count) * INDEX_ENTRY_SIZE;
+		if (uint64_t(p_index.size()) != path_data_offset + path_data_size)
+			return false;
+
+		const uint8_t *ptr = p_index.ptr();
+		r_entries.resize(entry_count);
+		for (uint32_t i = 0; i < entry_count; ++i) {
+			const uint64_t offset = uint64_t(i) * INDEX_ENTRY_SIZE;
+			const uint32_t path_offset = read_u32(ptr, offset + 4);
+			const uint32_t path_length = read_u32(ptr, offset + 8);
+			const uint32_t compression_mode = read_u32(ptr, offset + 12);
+
+			BundleEntry &entry = r_entries[i];
+			entry.path_hash = read_u32(ptr, offset);
+			entry.compression_mode = compression_mode == NO_COMPRESSION ? -1 : int(compression_mode);
+			entry.offset = read_u64(ptr, offset + 16);
+			entry.size = read_u32(ptr, offset + 24);
+			entry.decompressed_size = read_u32(ptr, offset + 28);
+			if (uint64_t(path_offset) + path_length > path_data_size or entry.offset + entry.size > p_file_size)
+				return false;
+
+			entry.path = String::utf8((const char *)ptr + path_data_offset + path_offset, path_length);
+		}
+
+		return true;
+	}
+
+	// Index of the entry with p_path in p_entries, which must be sorted, or -1 if there is none.
+	static int find_entry(const LocalVector<BundleEntry> &p_entries, const String &p_path) {
+		const uint32_t path_hash = p_path.hash();
+		int low = 0;
+		int high = p_entries.size();
+		while (low < high) {
+			const int middle = (low + high) / 2;
+			if (p_entries[middle].path_hash < path_hash) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+
+		for (int i = low; i < int(p_entries.size()) and p_entries[i].path_hash == path_hash; ++i) {
+			if (p_entries[i].path == p_path)
+				return i;
+		}
+
+		return -1;
+	}
+};
+
+} //namespace gdexpr
+
+#endif // GDExprFormat_H
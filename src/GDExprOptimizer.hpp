@@ -0,0 +1,438 @@
+#ifndef GDExprOptimizer_H
+#define GDExprOptimizer_H
+
+#include "godot_cpp/classes/expression.hpp"
+#include "godot_cpp/templates/hash_map.hpp"
+#include "godot_cpp/templates/hash_set.hpp"
+#include "godot_cpp/templates/local_vector.hpp"
+#include "godot_cpp/variant/utility_functions.hpp"
+
+using namespace godot;
+
+namespace gdexpr {
+
+// A token of a compiled godot expression. Tokens only store where they are in the expression text, they are never copied out of it unless they have to be.
+struct ExpressionToken {
+	enum Type {
+		IDENTIFIER,
+		NUMBER,
+		STRING,
+		SYMBOL,
+	};
+
+	Type type = SYMBOL;
+	int start = 0;
+	int length = 0;
+
+	int end() const { return start + length; }
+};
+
+_ALWAYS_INLINE_ bool is_identifier_start(char32_t c) {
+	return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or c == '_' or c > 127;
+}
+
+_ALWAYS_INLINE_ bool is_identifier_char(char32_t c) {
+	return is_identifier_start(c) or (c >= '0' and c <= '9');
+}
+
+// Split a compiled godot expression into identifiers, numbers, strings and symbols. Whitespace is skipped.
+// This only has to be good enough to find the boundaries of calls, brackets and literals, the godot expression parser still does the actual parsing.
+_ALWAYS_INLINE_ void tokenize_expression(const String &p_expression, LocalVector<ExpressionToken> &r_tokens) {
+	r_tokens.clear();
+	const char32_t *chars = p_expression.ptr();
+	const int length = p_expression.length();
+
+	int i = 0;
+	while (i < length) {
+		const char32_t c = chars[i];
+		if (c == ' ' or c == '\t' or c == '\n' or c == '\r') {
+			i++;
+			continue;
+		}
+
+		ExpressionToken token;
+		token.start = i;
+
+		if (is_identifier_start(c)) {
+			token.type = ExpressionToken::IDENTIFIER;
+			while (i < length and is_identifier_char(chars[i])) {
+				i++;
+			}
+		} else if (c >= '0' and c <= '9') {
+			// Hex, binary, exponents and digit separators are all swallowed into the number.
+			token.type = ExpressionToken::NUMBER;
+			while (i < length and (is_identifier_char(chars[i]) or chars[i] == '.')) {
+				i++;
+			}
+		} else if (c == '"' or c == '\'') {
+			token.type = ExpressionToken::STRING;
+			i++;
+			while (i < length and chars[i] != c) {
+				if (chars[i] == '\\')
+					i++;
+				i++;
+			}
+			i = MIN(i + 1, length);
+		} else {
+			token.type = ExpressionToken::SYMBOL;
+			i++;
+		}
+
+		token.length = i - token.start;
+		r_tokens.push_back(token);
+	}
+}
+
+// Compile time optimizations that run on the compiled godot expressions of a program.
+// Constant folding replaces sub expressions that are built only from literals and pure @GlobalScope functions with the literal they evaluate to.
+// Constant propagation replaces reads of variables that are only ever assigned one constant value with that value and removes the assignment.
+class ExpressionOptimizer {
+	// Functions that always return the same result for the same arguments and have no side effects, calls to these can be evaluated at compile time.
+	inline static const char *pure_functions[] = {
+		"abs", "absf", "absi", "acos", "acosh", "angle_difference", "asin", "asinh", "atan", "atan2", "atanh", "bezier_derivative", "bezier_interpolate", "ceil", "ceilf",
+		"ceili", "clamp", "clampf", "clampi", "cos", "cosh", "cubic_interpolate", "db_to_linear", "deg_to_rad", "ease", "exp", "floor", "floorf", "floori", "fmod",
+		"fposmod", "inverse_lerp", "is_equal_approx", "is_finite", "is_inf", "is_nan", "is_zero_approx", "lerp", "lerp_angle", "lerpf", "linear_to_db", "log", "max",
+		"maxf", "maxi", "min", "minf", "mini", "move_toward", "nearest_po2", "pingpong", "posmod", "pow", "rad_to_deg", "remap", "rotate_toward", "round", "roundf",
+		"roundi", "sign", "signf", "signi", "sin", "sinh", "smoothstep", "snapped", "snappedf", "snappedi", "sqrt", "step_decimals", "str", "tan", "tanh", "wrap",
+		"wrapf", "wrapi", "AABB", "Basis", "Color", "Plane", "Quaternion", "Rect2", "Rect2i", "Transform2D", "Transform3D", "Vector2", "Vector2i", "Vector3", "Vector3i",
+		"Vector4", "Vector4i", "bool", "int", "float", "String",
+	};
+
+	// Identifiers that are constant values or operators.
+	inline static const char *constant_identifiers[] = {
+		"PI", "TAU", "INF", "NAN", "true", "false", "null", "and", "or", "not", "in",
+	};
+
+	HashSet<String> pure_function_names;
+	HashSet<String> constant_names;
+
+	Ref<Expression> expression; // Used to evaluate constant sub expressions at compile time.
+	String text;
+	LocalVector<ExpressionToken> tokens;
+
+	struct Replacement {
+		int start = 0;
+		int end = 0;
+		String text;
+	};
+	LocalVector<Replacement> replacements;
+
+	struct SlotUsage {
+		int writes = 0;
+		bool is_read_before_write = false;
+		bool is_constant = false;
+		String literal;
+	};
+
+	String token_text(int p_token) const { return text.substr(tokens[p_token].start, tokens[p_token].length); }
+
+	bool is_symbol(int p_token, char32_t p_symbol) const {
+		return p_token >= 0 and p_token < int(tokens.size()) and tokens[p_token].type == ExpressionToken::SYMBOL and text[tokens[p_token].start] == p_symbol;
+	}
+
+	bool is_identifier(int p_token, const char *p_name) const { return tokens[p_token].type == ExpressionToken::IDENTIFIER and token_text(p_token) == p_name; }
+
+	bool is_opening_bracket(int p_token) const { return is_symbol(p_token, '(') or is_symbol(p_token, '[') or is_symbol(p_token, '{'); }
+	bool is_closing_bracket(int p_token) const { return is_symbol(p_token, ')') or is_symbol(p_token, ']') or is_symbol(p_token, '}'); }
+
+	// Returns the index of the bracket closing the one at p_token, or -1 if it is never closed.
+	int find_closing_bracket(int p_token) const {
+		int depth = 0;
+		for (int i = p_token; i < int(tokens.size()); ++i) {
+			if (is_opening_bracket(i)) {
+				depth++;
+			} else if (is_closing_bracket(i)) {
+				depth--;
+				if (depth == 0)
+					return i;
+			}
+		}
+
+		return -1;
+	}
+
+	// A token range is constant if every identifier in it is a constant, an operator, a call to a pure function or a property of a constant value.
+	bool is_constant_range(int p_start, int p_end) const {
+		for (int i = p_start; i < p_end; ++i) {
+			if (tokens[i].type != ExpressionToken::IDENTIFIER)
+				continue;
+
+			const bool is_call = is_symbol(i + 1, '(');
+			if (is_symbol(i - 1, '.')) {
+				// Properties of builtin types are pure, their methods might not be.
+				if (is_call)
+					return false;
+				continue;
+			}
+
+			const String name = token_text(i);
+			if (is_call and pure_function_names.has(name))
+				continue;
+
+			if (!is_call and constant_names.has(name))
+				continue;
+
+			return false;
+		}
+
+		return true;
+	}
+
+	// Evaluate a constant token range and write the literal it evaluates to into r_literal.
+	// Fails if the result can't be written as a literal that evaluates back to the exact same value.
+	bool evaluate_range(int p_start, int p_end, String &r_literal) {
+		const String range_text = text.substr(tokens[p_start].start, tokens[p_end - 1].end() - tokens[p_start].start);
+		if (expression->parse(range_text) != OK)
+			return false;
+
+		Variant result = expression->execute(Array(), nullptr, false, true);
+		if (expression->has_execute_failed())
+			return false;
+
+		switch (result.get_type()) {
+			case Variant::OBJECT:
+			case Variant::CALLABLE:
+			case Variant::SIGNAL:
+			case Variant::RID:
+				return false;
+			default:
+				break;
+		}
+
+		String literal = UtilityFunctions::var_to_str(result);
+		if (literal.contains("\n"))
+			return false;
+
+		if (expression->parse(literal) != OK)
+			return false;
+
+		Variant literal_result = expression->execute(Array(), nullptr, false, true);
+		if (expression->has_execute_failed() or literal_result.get_type() != result.get_type() or literal_result != result)
+			return false;
+
+		r_literal = literal.begins_with("-") ? "(" + literal + ")" : literal;
+		return true;
+	}
+
+	bool fold_to_literal(int p_start, int p_end) {
+		String literal;
+		if (!evaluate_range(p_start, p_end, literal))
+			return false;
+
+		Replacement replacement;
+		replacement.start = tokens[p_start].start;
+		replacement.end = tokens[p_end - 1].end();
+		if (text.substr(replacement.start, replacement.end - replacement.start) == literal)
+			return true; // Already a literal.
+
+		replacement.text = literal;
+		replacements.push_back(replacement);
+		return true;
+	}
+
+	// Fold a token range that is a whole expression on its own, the whole expression, a call argument or an element of an array or dictionary.
+	// If the range isn't constant as a whole, constant calls and brackets inside it are folded instead.
+	void fold_range(int p_start, int p_end) {
+		if (p_end - p_start > 1 and is_constant_range(p_start, p_end) and fold_to_literal(p_start, p_end))
+			return;
+
+		for (int i = p_start; i < p_end; ++i) {
+			const bool is_call = tokens[i].type == ExpressionToken::IDENTIFIER and is_symbol(i + 1, '(') and !is_symbol(i - 1, '.');
+			const int bracket = is_call ? i + 1 : i;
+			if (!is_opening_bracket(bracket))
+				continue;
+
+			const int closing = find_closing_bracket(bracket);
+			if (closing < 0 or closing >= p_end)
+				return;
+
+			// Calls to pure functions and parenthesized groups are complete expressions, so they can be folded in place.
+			// Other brackets (indexing, array and dictionary literals) can only have their elements folded.
+			const bool is_group = is_symbol(bracket, '(') and (is_call or (i == p_start or !(tokens[i - 1].type == ExpressionToken::IDENTIFIER or is_closing_bracket(i - 1))));
+			if (is_group and is_constant_range(i, closing + 1) and fold_to_literal(i, closing + 1)) {
+				i = closing;
+				continue;
+			}
+
+			int element_start = bracket + 1;
+			int depth = 0;
+			for (int j = bracket + 1; j < closing; ++j) {
+				if (is_opening_bracket(j)) {
+					depth++;
+				} else if (is_closing_bracket(j)) {
+					depth--;
+				} else if (depth == 0 and (is_symbol(j, ',') or is_symbol(j, ':'))) {
+					fold_range(element_start, j);
+					element_start = j + 1;
+				}
+			}
+			fold_range(element_start, closing);
+
+			i = closing;
+		}
+	}
+
+	String apply_replacements() const {
+		if (replacements.is_empty())
+			return text;
+
+		String result;
+		int position = 0;
+		for (const Replacement &replacement : replacements) {
+			result += text.substr(position, replacement.start - position) + replacement.text;
+			position = replacement.end;
+		}
+
+		return result + text.substr(position);
+	}
+
+	// If the token at p_token is a call to set_slot or get_slot with a constant slot index, returns the slot index, otherwise returns -1.
+	int get_slot_call(int p_token, const char *p_function) const {
+		if (is_symbol(p_token - 1, '.') or !is_identifier(p_token, p_function) or !is_symbol(p_token + 1, '('))
+			return -1;
+
+		if (p_token + 2 >= int(tokens.size()) or tokens[p_token + 2].type != ExpressionToken::NUMBER)
+			return -1;
+
+		const String slot = token_text(p_token + 2);
+		return slot.is_valid_int() ? int(slot.to_int()) : -1;
+	}
+
+	// Returns the slot of the variable read by p_token, or -1 if it doesn't read a variable.
+	int get_variable_read(int p_token, const HashMap<String, int> &p_input_variables) const {
+		if (p_input_variables.is_empty()) {
+			const int slot = get_slot_call(p_token, "get_slot");
+			return slot >= 0 and is_symbol(p_token + 3, ')') ? slot : -1;
+		}
+
+		if (tokens[p_token].type != ExpressionToken::IDENTIFIER or is_symbol(p_token - 1, '.') or is_symbol(p_token + 1, '('))
+			return -1;
+
+		const int *slot = p_input_variables.getptr(token_text(p_token));
+		return slot ? *slot : -1;
+	}
+
+public:
+	ExpressionOptimizer() {
+		for (const char *name : pure_functions) {
+			pure_function_names.insert(name);
+		}
+
+		for (const char *name : constant_identifiers) {
+			constant_names.insert(name);
+		}
+
+		expression.instantiate();
+	}
+
+	// Fold every constant sub expression of p_expression into a literal.
+	String fold_constants(const String &p_expression) {
+		text = p_expression;
+		tokenize_expression(text, tokens);
+		replacements.clear();
+
+		fold_range(0, tokens.size());
+		return apply_replacements();
+	}
+
+	// Replace reads of variables that are assigned exactly once, to a constant, before they are ever read with the constant and replace the assignment with 0,
+	// the value set_slot returns. p_variables_as_inputs tells if variables are read by name (as expression inputs) or with get_slot.
+	// NOTE: Propagated variables are never written to the script, so reading them by name with GDExprScript.get_var doesn't see them.
+	void propagate_constants(PackedStringArray &r_expressions, const PackedStringArray &p_variable_names, bool p_variables_as_inputs) {
+		if (p_variable_names.is_empty())
+			return;
+
+		HashMap<String, int> input_variables;
+		if (p_variables_as_inputs) {
+			for (int i = 0; i < p_variable_names.size(); ++i) {
+				input_variables.insert(p_variable_names[i], i);
+			}
+		}
+
+		LocalVector<SlotUsage> slot_usage;
+		slot_usage.resize(p_variable_names.size());
+
+		// Expressions run in order and each expression runs left to right, so a read that comes before the first write in that order reads the value from a previous run.
+		for (int e = 0; e < r_expressions.size(); ++e) {
+			text = r_expressions[e];
+			tokenize_expression(text, tokens);
+			for (int i = 0; i < int(tokens.size()); ++i) {
+				const int written_slot = get_slot_call(i, "set_slot");
+				if (written_slot >= 0 and written_slot < int(slot_usage.size()) and is_symbol(i + 3, ',')) {
+					SlotUsage &usage = slot_usage[written_slot];
+					usage.writes++;
+
+					const int closing = find_closing_bracket(i + 1);
+					if (usage.writes == 1 and closing > i + 4 and is_constant_range(i + 4, closing))
+						usage.is_constant = evaluate_range(i + 4, closing, usage.literal);
+					continue;
+				}
+
+				const int read_slot = get_variable_read(i, input_variables);
+				if (read_slot >= 0 and read_slot < int(slot_usage.size()) and slot_usage[read_slot].writes == 0)
+					slot_usage[read_slot].is_read_before_write = true;
+			}
+		}
+
+		bool has_propagated_slots = false;
+		for (const SlotUsage &usage : slot_usage) {
+			has_propagated_slots = has_propagated_slots or (usage.writes == 1 and usage.is_constant and !usage.is_read_before_write);
+		}
+
+		if (!has_propagated_slots)
+			return;
+
+		for (int e = 0; e < r_expressions.size(); ++e) {
+			text = r_expressions[e];
+			tokenize_expression(text, tokens);
+			replacements.clear();
+
+			for (int i = 0; i < int(tokens.size()); ++i) {
+				const int written_slot = get_slot_call(i, "set_slot");
+				const int read_slot = written_slot >= 0 ? -1 : get_variable_read(i, input_variables);
+				const int slot = written_slot >= 0 ? written_slot : read_slot;
+				if (slot < 0 or slot >= int(slot_usage.size()))
+					continue;
+
+				const SlotUsage &usage = slot_usage[slot];
+				if (usage.writes != 1 or !usage.is_constant or usage.is_read_before_write)
+					continue;
+
+				const int last_token = written_slot >= 0 ? find_closing_bracket(i + 1) : (p_variables_as_inputs ? i : i + 3);
+				if (last_token < 0)
+					continue;
+
+				Replacement replacement;
+				replacement.start = tokens[i].start;
+				replacement.end = tokens[last_token].end();
+				replacement.text = written_slot >= 0 ? String("0") : usage.literal;
+				replacements.push_back(replacement);
+				i = last_token;
+			}
+
+			r_expressions.set(e, apply_replacements());
+		}
+	}
+
+	// Run every optimization on the compiled expressions of a program.
+	PackedStringArray optimize(const PackedStringArray &p_expressions, const PackedStringArray &p_variable_names, bool p_variables_as_inputs) {
+		PackedStringArray optimized_expressions;
+		optimized_expressions.resize(p_expressions.size());
+		for (int i = 0; i < p_expressions.size(); ++i) {
+			optimized_expressions.set(i, fold_constants(p_expressions[i]));
+		}
+
+		propagate_constants(optimized_expressions, p_variable_names, p_variables_as_inputs);
+
+		// Propagated constants can make more of an expression constant, so fold again.
+		for (int i = 0; i < optimized_expressions.size(); ++i) {
+			optimized_expressions.set(i, fold_constants(optimized_expressions[i]));
+		}
+
+		return optimized_expressions;
+	}
+};
+
+} //namespace gdexpr
+
+#endif // GDExprOptimizer_H
@@ -0,0 +1,90 @@
+#ifndef GDExprResourceFormat_H
+#define GDExprResourceFormat_H
+
+#include "godot_cpp/classes/resource_format_loader.hpp"
+#include "godot_cpp/classes/resource_format_saver.hpp"
+
+#include "GDExpr.hpp"
+
+using namespace godot;
+
+namespace gdexpr {
+
+// Loads gdexpr files as GDExprProgram resources, so they go through the resource cache and can be loaded on a background thread with
+// ResourceLoader.load_threaded_request. Source .gdexpr files are compiled, precompiled .gdexprc files saved with GDExpr.save_program are only parsed.
+class GDExprResourceFormatLoader : public ResourceFormatLoader {
+	GDCLASS(GDExprResourceFormatLoader, ResourceFormatLoader)
+
+protected:
+	static void _bind_methods() {}
+
+public:
+	PackedStringArray _get_recognized_extensions() const override {
+		PackedStringArray extensions;
+		extensions.append("gdexpr");
+		extensions.append("gdexprc");
+		return extensions;
+	}
+
+	bool _handles_type(const StringName &p_type) const override { return p_type == StringName("GDExprProgram"); }
+
+	String _get_resource_type(const String &p_path) const override {
+		const String extension = p_path.get_extension().to_lower();
+		return extension == "gdexpr" or extension == "gdexprc" ? "GDExprProgram" : "";
+	}
+
+	bool _exists(const String &p_path) const override { return FileAccess::file_exists(p_path); }
+
+	// Source files are compiled without inputs or a base instance, so their comptime code can only call @GlobalScope functions. Scripts that need either are
+	// still compiled with GDExpr.compile_program.
+	Variant _load(const String &p_path, const String &, bool, int32_t) const override {
+		GDExpr *compiler = GDExpr::get_singleton();
+		ERR_FAIL_NULL_V(compiler, ERR_UNAVAILABLE);
+		if (!FileAccess::file_exists(p_path))
+			return ERR_FILE_NOT_FOUND;
+
+		Ref<GDExprProgram> program;
+		if (p_path.get_extension().to_lower() == "gdexprc") {
+			program = compiler->load_program(p_path);
+		} else {
+			program = compiler->compile_program(Array(), Ref<GDExprScript>(), p_path);
+		}
+
+		if (program.is_null())
+			return ERR_FILE_CORRUPT;
+
+		return program;
+	}
+};
+
+// Saves GDExprProgram resources to precompiled .gdexprc files with GDExpr.save_program. Programs don't keep their source, so they can't be saved as .gdexpr.
+class GDExprResourceFormatSaver : public ResourceFormatSaver {
+	GDCLASS(GDExprResourceFormatSaver, ResourceFormatSaver)
+
+protected:
+	static void _bind_methods() {}
+
+public:
+	bool _recognize(const Ref<Resource> &p_resource) const override { return Object::cast_to<GDExprProgram>(p_resource.ptr()) != nullptr; }
+
+	PackedStringArray _get_recognized_extensions(const Ref<Resource> &p_resource) const override {
+		PackedStringArray extensions;
+		if (_recognize(p_resource))
+			extensions.append("gdexprc");
+
+		return extensions;
+	}
+
+	Error _save(const Ref<Resource> &p_resource, const String &p_path, uint32_t) override {
+		GDExpr *compiler = GDExpr::get_singleton();
+		ERR_FAIL_NULL_V(compiler, ERR_UNAVAILABLE);
+
+		Ref<GDExprProgram> program = p_resource;
+		ERR_FAIL_COND_V(program.is_null(), ERR_INVALID_PARAMETER);
+		return compiler->save_program(program, p_path);
+	}
+};
+
+} //namespace gdexpr
+
+#endif // GDExprResourceFormat_H
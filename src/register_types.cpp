@@ -2,16 +2,23 @@
 
 #include <gdextension_interface.h>
 #include <godot_cpp/classes/engine.hpp>
+#include <godot_cpp/classes/resource_loader.hpp>
+#include <godot_cpp/classes/resource_saver.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/core/defs.hpp>
 #include <godot_cpp/godot.hpp>
 
 #include "GDExpr.hpp"
 #include "GDExprExample.hpp"
+#include "GDExprResourceFormat.hpp"
 
 using namespace godot;
 using namespace gdexpr;
 
+static Ref<GDExpr> gdexpr_singleton; // Compile tasks hold Ref<GDExpr>, so the singleton has to be owned by a reference too or they would free it.
+static Ref<GDExprResourceFormatLoader> resource_format_loader;
+static Ref<GDExprResourceFormatSaver> resource_format_saver;
+
 void initialize_gdexpr_module(ModuleInitializationLevel p_level) {
 	if (p_level != MODULE_INITIALIZATION_LEVEL_SCENE) {
 		return;
@@ -19,7 +26,21 @@ void initialize_gdexpr_module(ModuleInitializationLevel p_level) {
 
 	GDREGISTER_CLASS(GDExpr)
 	GDREGISTER_CLASS(GDExprScript)
-	Engine::get_singleton()->register_singleton("GDExpr", memnew(GDExpr));
+	GDREGISTER_CLASS(GDExprProgram)
+	GDREGISTER_ABSTRACT_CLASS(GDExprExecution)
+	GDREGISTER_ABSTRACT_CLASS(GDExprBatchTask)
+	GDREGISTER_ABSTRACT_CLASS(GDExprDirectoryTask)
+	GDREGISTER_ABSTRACT_CLASS(GDExprBundle)
+	GDREGISTER_ABSTRACT_CLASS(GDExprCompileTask)
+	GDREGISTER_CLASS(GDExprResourceFormatLoader)
+	GDREGISTER_CLASS(GDExprResourceFormatSaver)
+	gdexpr_singleton.instantiate();
+	Engine::get_singleton()->register_singleton("GDExpr", gdexpr_singleton.ptr());
+
+	resource_format_loader.instantiate();
+	ResourceLoader::get_singleton()->add_resource_format_loader(resource_format_loader);
+	resource_format_saver.instantiate();
+	ResourceSaver::get_singleton()->add_resource_format_saver(resource_format_saver);
 
 	//GDREGISTER_CLASS(GDExprExampleNode)
 	//GDREGISTER_CLASS(GDExprExampleScript)
@@ -27,6 +48,12 @@ void initialize_gdexpr_module(ModuleInitializationLevel p_level) {
 
 void uninitialize_gdexpr_module(ModuleInitializationLevel p_level) {
 	if (p_level == MODULE_INITIALIZATION_LEVEL_SCENE) {
+		ResourceLoader::get_singleton()->remove_resource_format_loader(resource_format_loader);
+		resource_format_loader.unref();
+		ResourceSaver::get_singleton()->remove_resource_format_saver(resource_format_saver);
+		resource_format_saver.unref();
+		Engine::get_singleton()->unregister_singleton("GDExpr");
+		gdexpr_singleton.unref();
 	}
 }
 